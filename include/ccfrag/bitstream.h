@@ -0,0 +1,193 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CCFRAG_LITTLE_ENDIAN 1
+#else
+#define CCFRAG_LITTLE_ENDIAN 0
+#endif
+
+namespace ccfrag{
+	// LSB first bit stream used by deflate and compress.
+	// bits are kept in a 64 bit register and loaded/stored a word at a time.
+	class bitstream{
+	public:
+		enum{
+			MAX_READ_BITS = 56,
+			MAX_WRITE_BITS = 56,
+		};
+		// little endian 8 bytes, a single unaligned access on little endian hosts
+		static uint64_t load_word(const char * p)
+		{
+			uint64_t word = 0;
+#if CCFRAG_LITTLE_ENDIAN
+			memcpy(&word, p, sizeof(word));
+#else
+			for(size_t i = 0; i < 8; ++i){
+				word |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (i * 8);
+			}
+#endif
+			return word;
+		}
+		static void store_word(char * p, uint64_t word)
+		{
+#if CCFRAG_LITTLE_ENDIAN
+			memcpy(p, &word, sizeof(word));
+#else
+			for(size_t i = 0; i < 8; ++i){
+				p[i] = static_cast<char>(word >> (i * 8));
+			}
+#endif
+		}
+		class input_type{
+		public:
+			const char * begin; // next byte to load into bits
+			const char * end;
+			uint64_t bits;
+			size_t bit_count;
+			input_type(const input_type& rhs)
+				: begin(rhs.begin)
+				, end(rhs.end)
+				, bits(rhs.bits)
+				, bit_count(rhs.bit_count)
+			{
+			}
+			input_type(const char* begin, const char* end)
+				: begin(begin)
+				, end(end)
+				, bits(0)
+				, bit_count(0)
+			{
+			}
+			bool empty() const
+			{
+				return !bit_count && end <= begin;
+			}
+			// remaining bits
+			size_t size() const
+			{
+				return (end <= begin ? 0 : (end - begin) * 8) + bit_count;
+			}
+			void refill()
+			{
+				if(8 <= end - begin){
+					bits |= load_word(begin) << bit_count;
+					size_t count = (63 - bit_count) >> 3;
+					begin += count;
+					bit_count += count * 8;
+				} else{
+					while(bit_count <= 56 && begin < end){
+						bits |= static_cast<uint64_t>(static_cast<uint8_t>(*begin)) << bit_count;
+						++begin;
+						bit_count += 8;
+					}
+				}
+			}
+			// next bits without advance, bits after end of input are zero
+			uint64_t peek(size_t peek_bits)
+			{
+				if(bit_count < peek_bits){
+					refill();
+				}
+				return bits & ((static_cast<uint64_t>(1) << peek_bits) - 1);
+			}
+			void advance(size_t count)
+			{
+				if(bit_count < count){
+					count -= bit_count;
+					bits = 0;
+					bit_count = 0;
+					size_t bytes = std::min<size_t>(count / 8, end <= begin ? 0 : end - begin);
+					begin += bytes;
+					count -= bytes * 8;
+					refill();
+					count = std::min(count, bit_count);
+				}
+				bits >>= count;
+				bit_count -= count;
+			}
+			template<typename T>
+			bool read(T& data, size_t read_bits)
+			{
+				if(sizeof(T) * 8 < read_bits || MAX_READ_BITS < read_bits){
+					return false;
+				}
+				if(bit_count < read_bits){
+					refill();
+					if(bit_count < read_bits){
+						return false;
+					}
+				}
+				data = static_cast<T>(bits & ((static_cast<uint64_t>(1) << read_bits) - 1));
+				bits >>= read_bits;
+				bit_count -= read_bits;
+				return true;
+			}
+			void skip_to_byte_align()
+			{
+				advance(bit_count % 8);
+			}
+			// give back loaded bytes to begin, input must be byte aligned
+			void unload()
+			{
+				begin -= bit_count / 8;
+				bits = 0;
+				bit_count = 0;
+			}
+		};
+		class output_type{
+		public:
+			std::vector<char> output;
+			uint64_t bits;
+			size_t bit_count;
+			output_type()
+				: bits(0)
+				, bit_count(0)
+			{
+			}
+			// written bits
+			size_t size() const
+			{
+				return output.size() * 8 + bit_count;
+			}
+			template<typename T>
+			bool write(T write_data, size_t write_bits)
+			{
+				if(MAX_WRITE_BITS < write_bits){
+					return false;
+				}
+				uint64_t data = static_cast<uint64_t>(write_data) & ((static_cast<uint64_t>(1) << write_bits) - 1);
+				if(bit_count + write_bits < 64){
+					bits |= data << bit_count;
+					bit_count += write_bits;
+					return true;
+				}
+				bits |= data << bit_count;
+				size_t offset = output.size();
+				output.resize(offset + 8);
+				store_word(&output[offset], bits);
+				bits = data >> (64 - bit_count);
+				bit_count = bit_count + write_bits - 64;
+				return true;
+			}
+			// write buffered bits and pad to byte boundary
+			void flush()
+			{
+				while(bit_count){
+					output.push_back(static_cast<char>(bits));
+					bits >>= 8;
+					bit_count = 8 < bit_count ? bit_count - 8 : 0;
+				}
+				bits = 0;
+			}
+			bool write_bytes(const char * data, size_t length)
+			{
+				flush();
+				output.insert(output.end(), data, data + length);
+				return true;
+			}
+		};
+	};
+}
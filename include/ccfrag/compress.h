@@ -1,9 +1,8 @@
 #pragma once
 #include <string>
-#include <map>
 #include <vector>
-#include <deque>
 #include <algorithm>
+#include <ccfrag/bitstream.h>
 
 namespace ccfrag{
 	// https://xlinux.nist.gov/dads/HTML/lempelZivWelch.html
@@ -14,213 +13,374 @@ namespace ccfrag{
 		typedef uint32_t code_type;
 		typedef std::pair<code_type, size_t> code_bit_type;
 	public:
-		class input_type
+		typedef bitstream::input_type input_type;
+		class output_type : public bitstream::output_type
 		{
 		public:
-			const char * begin;
-			const char * end;
-			size_t used_bits;
-			input_type(const input_type& rhs)
-				: begin(rhs.begin)
-				, end(rhs.end)
-				, used_bits(rhs.used_bits)
-			{
-			}
-			input_type(const char* begin, const char* end)
-				: begin(begin)
-				, end(end)
-				, used_bits(0)
+			bool write(const code_bit_type& data)
 			{
+				if(32 < data.second){
+					return false;
+				}
+				return bitstream::output_type::write(data.first, data.second);
 			}
-			bool empty() const
+		};
+		// open addressing hash table from (prefix code, symbol) to code
+		class code_table{
+		public:
+			enum{
+				HASH_BITS = 17, // twice of 16 bit codes
+				HASH_SIZE = 1 << HASH_BITS,
+				HASH_MASK = HASH_SIZE - 1,
+				EMPTY = 0, // key of empty slot
+			};
+			std::vector<uint32_t> keys;
+			std::vector<uint16_t> codes;
+			code_table()
+				: keys(HASH_SIZE, EMPTY)
+				, codes(HASH_SIZE, 0)
 			{
-				return end <= begin;
 			}
-			size_t size() const
+			void clear()
 			{
-				return empty() ? 0 : (end - begin) * 8 - used_bits;
+				std::fill(keys.begin(), keys.end(), EMPTY);
 			}
-			void advance(size_t count)
+			static uint32_t key(code_type prefix, symbol_type c)
 			{
-				used_bits += count;
-				begin += used_bits / 8;
-				used_bits %= 8;
+				return ((prefix << 8) | static_cast<uint8_t>(c)) + 1;
 			}
-			bool read(code_type& data, size_t read_bits)
+			// index of entry for key or empty slot to insert key
+			size_t find(uint32_t k) const
 			{
-				if(64 < read_bits || size() < read_bits){
-					return false;
+				size_t index = (k * 2654435761U) >> (32 - HASH_BITS);
+				while(keys[index] != k && keys[index] != EMPTY){
+					index = (index + 1) & HASH_MASK;
 				}
-				data = 0;
-				size_t shift = 0;
-				static const uint8_t masks[9] = {0, 0x1, 0x3, 0x7, 0xF, 0x1F, 0x3F, 0x7F, 0xFF};
-				while(read_bits){
-					auto bits = std::min((8 - used_bits), read_bits);
-					data |= ((*begin >> used_bits) & masks[bits]) << shift;
-					shift += bits;
-					read_bits -= bits;
-					advance(bits);
-				}
-				return true;
+				return index;
 			}
 		};
-		class output_type
-		{
+		enum{
+			MAGIC_NUMBER1 = 0x1F,
+			MAGIC_NUMBER2 = 0x9D,
+			BLOCK_MODE = 0x80,
+			BITS_MASK = 0x1F,
+			MIN_BITS = 9,
+			MAX_BITS = 16,
+			CLEAR_CODE = 256, // table setup again in block mode
+			HEADER_SIZE = 3,
+		};
+		class encoder{
 		public:
-			std::deque<char> output;
-			uint8_t byte;
-			size_t used_bits;
-			output_type()
-				: byte(0)
-				, used_bits(0)
+			enum{
+				CHECK_GAP = 10000, // input bytes between checks of compression ratio after table is full
+			};
+			code_table codes;
+			output_type out;
+			char max_bits;
+			bool block_mode;
+			code_type max_code;
+			code_type next_code;
+			size_t current_max_bits;
+			code_type prefix; // code of current string
+			bool has_prefix;
+			bool finished;
+			uint64_t bytes_in;
+			uint64_t bits_out;
+			size_t group_bits; // bits from last alignment
+			uint64_t checkpoint;
+			uint64_t ratio; // bytes_in / bytes_out with 8 bits fraction at last check
+			encoder(char max_bits = MAX_BITS, bool block_mode = true)
+				: max_bits(std::max<char>(MIN_BITS, std::min<char>(MAX_BITS, max_bits)))
+				, block_mode(block_mode)
+				, max_code((static_cast<code_type>(1) << this->max_bits) - 1)
+				, next_code(block_mode ? CLEAR_CODE + 1 : CLEAR_CODE)
+				, current_max_bits(MIN_BITS)
+				, prefix(0)
+				, has_prefix(false)
+				, finished(false)
+				, bytes_in(0)
+				, bits_out(HEADER_SIZE * 8)
+				, group_bits(0)
+				, checkpoint(CHECK_GAP)
+				, ratio(0)
 			{
+				// header
+				out.write(code_bit_type(MAGIC_NUMBER1, 8));
+				out.write(code_bit_type(MAGIC_NUMBER2, 8));
+				out.write(code_bit_type((block_mode ? BLOCK_MODE : 0) | this->max_bits, 8));
 			}
-			bool write(const code_bit_type& data)
+			void write_code(code_type code)
+			{
+				out.write(code_bit_type(code, current_max_bits));
+				bits_out += current_max_bits;
+				group_bits += current_max_bits;
+			}
+			// codes are read by groups of current_max_bits bytes, pad to group boundary on changing bits.
+			void align()
+			{
+				size_t remain = group_bits % (current_max_bits * 8);
+				for(size_t pad = remain ? current_max_bits * 8 - remain : 0; pad; ){
+					size_t count = std::min<size_t>(pad, 32);
+					out.write(code_bit_type(0, count));
+					bits_out += count;
+					pad -= count;
+				}
+				group_bits = 0;
+			}
+			// start new table by CLEAR if compression ratio is worse than last check, as ncompress
+			void check_ratio()
+			{
+				checkpoint = bytes_in + CHECK_GAP;
+				uint64_t current_ratio = (bytes_in << 8) / std::max<uint64_t>(1, bits_out / 8);
+				if(ratio <= current_ratio){
+					ratio = current_ratio;
+					return;
+				}
+				ratio = 0;
+				codes.clear();
+				next_code = CLEAR_CODE + 1;
+				write_code(CLEAR_CODE);
+				align();
+				current_max_bits = MIN_BITS;
+			}
+			// compress input and append output, output is not complete until finish
+			bool write(std::vector<char>& output, const char * data, size_t size)
 			{
-				auto write_data = data.first;
-				auto write_bits = data.second;
-				if(32 < write_bits){
+				if(finished){
 					return false;
 				}
-				static const uint8_t masks[9] = {0, 0x1, 0x3, 0x7, 0xF, 0x1F, 0x3F, 0x7F, 0xFF};
-				while(write_bits){
-					auto bits = std::min((8 - used_bits), write_bits);
-					byte |= (write_data & masks[bits]) << used_bits;
-					used_bits += bits;
-					write_bits -= bits;
-					write_data >>= bits;
-					if(used_bits == 8){
-						flush();
+				for(const char * end = data + size; data != end; ++data){
+					symbol_type c = *data;
+					++bytes_in;
+					if((static_cast<code_type>(1) << current_max_bits) < next_code){
+						if(current_max_bits < static_cast<size_t>(max_bits)){
+							align();
+							++current_max_bits;
+						}
+					}
+					if(!has_prefix){
+						prefix = static_cast<uint8_t>(c);
+						has_prefix = true;
+						continue;
+					}
+					uint32_t key = code_table::key(prefix, c);
+					size_t index = codes.find(key);
+					if(codes.keys[index] == key){
+						prefix = codes.codes[index];
+						continue;
+					}
+					// not found in dictionary
+					write_code(prefix);
+					prefix = static_cast<uint8_t>(c);
+					if(next_code <= max_code){
+						codes.keys[index] = key;
+						codes.codes[index] = static_cast<uint16_t>(next_code++);// add new code.
+					} else if(block_mode && checkpoint <= bytes_in){
+						check_ratio();
 					}
 				}
+				output.insert(output.end(), out.output.begin(), out.output.end());
+				out.output.clear();
 				return true;
 			}
-			void flush()
+			bool finish(std::vector<char>& output)
 			{
-				if(used_bits){
-					output.push_back(byte);
-					used_bits = 0;
-					byte = 0;
+				if(finished){
+					return false;
+				}
+				if(has_prefix){
+					write_code(prefix);
 				}
+				out.flush();
+				finished = true;
+				output.insert(output.end(), out.output.begin(), out.output.end());
+				out.output.clear();
+				return true;
 			}
 		};
-		static bool encode(std::vector<char>& output, const std::vector<char>& input, char max_bits = 16, bool block_mode = true)
-		{
-			// header
-			static const code_bit_type magic_number1 = code_bit_type(0x1f, 8);
-			static const code_bit_type magic_number2 = code_bit_type(0x9d, 8);
-			output_type out;
-			if(max_bits < 9) max_bits = 9;
-			if(16 < max_bits) max_bits = 16;
-			code_type max_code = (static_cast<code_type>(1) << max_bits) - 1;
-			out.write(magic_number1);
-			out.write(magic_number2);
-			out.write(code_bit_type((block_mode ? 0x80 : 0)| max_bits, 8));
-			std::map<std::string, code_type> codes;
-			for(code_type i = 0; i < 256; ++i){
-				codes[std::string(1, static_cast<symbol_type>(i))] = i;
-			}
-			code_type next_code = 257; // 256 is reserved for EOF(table setup again)
-			size_t current_max_bits = 9;
-			std::string current_string;
-			for(auto it = input.begin(), end = input.end(); it != end; ++it){
-				symbol_type c = *it;
-				current_string.push_back(c);
-				if((static_cast<code_type>(1) << current_max_bits) < next_code){
-					if(current_max_bits < 16){
-						++current_max_bits;
-					}
-				}
-				auto cit = codes.find(current_string);
-				if(cit == codes.end()){ // not found in dictionary
-					if(next_code <= max_code){
-						codes[current_string] = next_code++;// add new code.
-					} // else for checking output EOF
-					current_string.pop_back(); // change to word in dictionary
-					cit = codes.find(current_string);
-					if(cit == codes.end()){
-						return false;
+		class decoder{
+		public:
+			input_type in;
+			size_t header_size; // read bytes of header
+			bool block_mode;
+			char max_bits;
+			code_type max_code;
+			// string of code is string of prefix[code] followed by suffix[code]
+			std::vector<uint16_t> prefix;
+			std::vector<uint8_t> suffix;
+			std::vector<uint16_t> length;
+			bool has_previous;
+			code_type previous_code;
+			uint8_t first_symbol; // first symbol of previous string
+			size_t current_max_bits;
+			code_type next_code;
+			size_t read_size; // bits from last alignment
+			size_t skip_bits; // padding bits to skip
+			decoder()
+				: in(nullptr, nullptr)
+				, header_size(0)
+				, block_mode(false)
+				, max_bits(0)
+				, max_code(0)
+				, has_previous(false)
+				, previous_code(0)
+				, first_symbol(0)
+				, current_max_bits(MIN_BITS)
+				, next_code(0)
+				, read_size(0)
+				, skip_bits(0)
+			{
+			}
+			bool read_header()
+			{
+				code_type code;
+				while(header_size < HEADER_SIZE && in.read(code, 8)){
+					switch(header_size++){
+					case 0:
+						if(code != MAGIC_NUMBER1){
+							return false;
+						}
+						break;
+					case 1:
+						if(code != MAGIC_NUMBER2){
+							return false;
+						}
+						break;
+					default:
+						block_mode = (code & BLOCK_MODE ? true : false);
+						max_bits = (code & BITS_MASK);
+						if(max_bits < MIN_BITS || MAX_BITS < max_bits) {
+							return false;
+						}
+						max_code = (static_cast<code_type>(1) << max_bits) - 1;
+						prefix.assign(max_code + 1, 0);
+						suffix.assign(max_code + 1, 0);
+						length.assign(max_code + 1, 1);
+						for(code_type i = 0; i < 256; ++i){
+							suffix[i] = static_cast<uint8_t>(i);
+						}
+						next_code = block_mode ? CLEAR_CODE + 1 : CLEAR_CODE;
+						break;
 					}
-					out.write(code_bit_type(cit->second, current_max_bits));
-					current_string = c;
 				}
+				return true;
 			}
-			auto cit = codes.find(current_string);
-			if(cit == codes.end()){
-				return false;
-			}
-			out.write(code_bit_type(cit->second, current_max_bits));
-			out.flush();
-			output.assign(out.output.begin(), out.output.end());
-			return true;
-		}
-		static bool decode(std::vector<char>& output, const std::vector<char>& input)
-		{
-			input_type in(input.data(), input.data() + input.size());
-			static const code_type eof_code = 256;
-			static const code_type magic_number1 = 0x1F;
-			static const code_type magic_number2 = 0x9D;
-			code_type code;
-			if(!in.read(code, 8) || code != magic_number1){
-				return false;
+			// codes are written by groups of current_max_bits bytes, skip padding to group boundary on changing bits.
+			void align()
+			{
+				size_t block_size = current_max_bits * 8;
+				read_size %= block_size;
+				if(read_size){
+					skip_bits = block_size - read_size;
+					read_size = 0;
+				}
 			}
-			if(!in.read(code, 8) || code != magic_number2){
-				return false;
+			// extend output to at least size, by about 4 times of remaining input to reduce resizing
+			void extend(std::vector<char>& output, size_t size) const
+			{
+				if(output.size() < size){
+					output.resize(std::max(size, output.size() + in.size() / 2 + 64));
+				}
 			}
-			if(!in.read(code, 8)){
-				return false;
+			// write string of code backwards from end
+			char * write_string(char * end, code_type code) const
+			{
+				for(; 256 <= code; code = prefix[code]){
+					*--end = static_cast<char>(suffix[code]);
+				}
+				*--end = static_cast<char>(suffix[code]);
+				return end;
 			}
-			const bool block_mode = (code & 0x80 ? true : false);
-			const char max_bits = (code & 0x7F);
-			if(max_bits < 9 || 16 < max_bits) {
-				return false;
+			// decode a fragment of input and append output
+			bool write(std::vector<char>& output, const char * data, size_t size)
+			{
+				in.begin = data;
+				in.end = data + size;
+				size_t position = output.size();
+				bool result = decode(output, position);
+				output.resize(position);
+				// keep rest of fragment in bit buffer until next write
+				in.refill();
+				in.begin = in.end = nullptr;
+				return result;
 			}
-			const code_type max_code = (static_cast<code_type>(1) << max_bits) - 1;
-			std::map<code_type, std::string> strings;
-			for(code_type i = 0; i < 256; ++i){
-				strings.insert(std::make_pair(i, std::string(1, i)));
-			}
-			std::string previous_string;
-			size_t current_max_bits = 9;
-			code_type next_code = block_mode ? 257 : 256;
-			std::deque<char> out;
-			size_t read_size = 0;
-			while(in.read(code, current_max_bits)){
-				read_size += current_max_bits;
-				if(block_mode && code == eof_code){
-					size_t block_size = current_max_bits * 8;
-					read_size %= block_size;
-					if(read_size){//align to block
-						in.advance(block_size - read_size);
-						read_size = 0;
-					}
-					current_max_bits = 9;
-					next_code = 256;
-					continue;
+			// output is decoded to [0, position), output is extended beyond position
+			bool decode(std::vector<char>& output, size_t& position)
+			{
+				if(!read_header()){
+					return false;
 				}
-				auto sit = strings.find(code);
-				if(sit == strings.end() || next_code <= code){
-					if(previous_string.empty()){
-						fprintf(stderr, "found previous_string empty on unknown code 0x%x , strings size %zd\n", code, strings.size());
+				if(header_size < HEADER_SIZE){
+					return true;
+				}
+				code_type code;
+				while(true){
+					if(skip_bits){
+						size_t count = std::min(skip_bits, in.size());
+						in.advance(count);
+						skip_bits -= count;
+						if(skip_bits){
+							return true;
+						}
+					}
+					if(!in.read(code, current_max_bits)){
+						return true;
+					}
+					read_size += current_max_bits;
+					if(block_mode && code == CLEAR_CODE){
+						align();
+						current_max_bits = MIN_BITS;
+						next_code = CLEAR_CODE;
+						continue;
+					}
+					size_t string_length;
+					if(code < next_code){
+						string_length = length[code];
+						extend(output, position + string_length);
+						write_string(&output[position] + string_length, code);
+					} else if(code == next_code && has_previous){
+						// previous string followed by its first symbol
+						string_length = length[previous_code] + 1;
+						extend(output, position + string_length);
+						write_string(&output[position] + string_length - 1, previous_code);
+						output[position + string_length - 1] = static_cast<char>(first_symbol);
+					} else{
+						fprintf(stderr, "unknown code 0x%x, next code 0x%x\n", code, next_code);
 						return false;
 					}
-					strings[code] = previous_string + previous_string[0];
-					sit = strings.find(code);
-				}
-				auto& string = sit->second;
-				out.insert(out.end(), string.begin(), string.end());
-				if(!previous_string.empty() && next_code <= max_code){
-					strings[next_code++] = previous_string + string[0];
-					if((static_cast<code_type>(1) << current_max_bits) - 1 < next_code){
-						if(current_max_bits < 16){
-							++current_max_bits;
+					first_symbol = static_cast<uint8_t>(output[position]);
+					if(has_previous && next_code <= max_code){
+						prefix[next_code] = static_cast<uint16_t>(previous_code);
+						suffix[next_code] = first_symbol;
+						length[next_code] = static_cast<uint16_t>(length[previous_code] + 1);
+						++next_code;
+						if((static_cast<code_type>(1) << current_max_bits) - 1 < next_code){
+							if(current_max_bits < static_cast<size_t>(max_bits)){
+								align();
+								++current_max_bits;
+							}
 						}
 					}
+					has_previous = true;
+					previous_code = code;
+					position += string_length;
 				}
-				previous_string = string;
 			}
-			output.assign(out.begin(), out.end());
-			return true;
+		};
+		static bool encode(std::vector<char>& output, const std::vector<char>& input, char max_bits = MAX_BITS, bool block_mode = true)
+		{
+			encoder e(max_bits, block_mode);
+			output.clear();
+			return e.write(output, input.data(), input.size()) && e.finish(output);
+		}
+		static bool decode(std::vector<char>& output, const std::vector<char>& input)
+		{
+			decoder d;
+			output.clear();
+			if(!d.write(output, input.data(), input.size())){
+				return false;
+			}
+			return d.header_size == HEADER_SIZE;
 		}
 	};
 }
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#if defined(__x86_64__) || defined(_M_X64)
+#define CCFRAG_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CCFRAG_TARGET(features)
+#else
+#include <cpuid.h>
+// enable instruction set for a function, so that it can be selected at runtime without global compiler options
+#define CCFRAG_TARGET(features) __attribute__((target(features)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CCFRAG_AARCH64
+#ifdef _MSC_VER
+#define CCFRAG_TARGET(features)
+#else
+#define CCFRAG_TARGET(features) __attribute__((target(features)))
+#endif
+#if defined(__linux__) && !defined(__ARM_FEATURE_CRC32)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+namespace ccfrag{
+	// cpu features for runtime selection of simd kernels
+	class cpu{
+	public:
+#ifdef CCFRAG_X86_64
+		static void cpuid(uint32_t leaf, uint32_t info[4])
+		{
+#ifdef _MSC_VER
+			int regs[4];
+			__cpuidex(regs, static_cast<int>(leaf), 0);
+			for(size_t i = 0; i < 4; ++i){
+				info[i] = static_cast<uint32_t>(regs[i]);
+			}
+#else
+			__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+		}
+		// XCR0, state components enabled by os
+		static uint64_t xgetbv()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			uint32_t eax, edx;
+			__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+		}
+		static bool has_pclmul()
+		{
+			uint32_t info[4];
+			cpuid(1, info);
+			return (info[2] & (1 << 1)) != 0;
+		}
+		static bool has_avx2()
+		{
+			uint32_t info[4];
+			cpuid(0, info);
+			if(info[0] < 7){
+				return false;
+			}
+			cpuid(1, info);
+			const uint32_t osxsave_avx = (1 << 27) | (1 << 28);
+			if((info[2] & osxsave_avx) != osxsave_avx || (xgetbv() & 6) != 6){
+				return false;
+			}
+			cpuid(7, info);
+			return (info[1] & (1 << 5)) != 0;
+		}
+#endif
+#ifdef CCFRAG_AARCH64
+		// crc32 instructions, optional in armv8.0
+		static bool has_crc32()
+		{
+#if defined(__ARM_FEATURE_CRC32)
+			return true;
+#elif defined(__linux__)
+			return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+			return false;
+#endif
+		}
+#endif
+		// index of lowest set bit, x must not be 0
+		static size_t count_trailing_zeros(uint64_t x)
+		{
+#if defined(_MSC_VER) && defined(CCFRAG_X86_64)
+			unsigned long index;
+			_BitScanForward64(&index, x);
+			return index;
+#elif defined(__GNUC__)
+			return static_cast<size_t>(__builtin_ctzll(x));
+#else
+			size_t n = 0;
+			for(; !(x & 1); x >>= 1){
+				++n;
+			}
+			return n;
+#endif
+		}
+	};
+}
@@ -1,10 +1,13 @@
 #pragma once
 #include <string>
-#include <map>
 #include <vector>
-#include <deque>
-#include <set>
+#include <functional>
 #include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <ccfrag/bitstream.h>
+#include <ccfrag/cpu.h>
 
 namespace ccfrag{
 	// https://tools.ietf.org/html/rfc1951
@@ -19,9 +22,11 @@ namespace ccfrag{
 		public:
 			size_t length;
 			code_type code;
+			code_type reversed; // code in LSB first order of output
 			code_info()
 				: length(0)
 				, code(0)
+				, reversed(0)
 			{
 			}
 			bool operator<(const code_info& rhs) const
@@ -44,20 +49,164 @@ namespace ccfrag{
 			MAX_LENGTH = 258,
 			MIN_DISTANCE = 1,
 			MAX_DISTANCE = 32768,
+			WINDOW_SIZE = 32768,
 			END_OF_BLOCK = 256,
 			MAX_BLOCK_SIZE = 65535,
 			MAX_DISTANCE_CODE = 32,
 			MAX_LITERAL_CODE = 288,
+			FAST_BITS = 9,
+			MIN_LEVEL = 1,
+			MAX_LEVEL = 9,
+			DEFAULT_LEVEL = 6,
+			OPTIMAL_LEVEL = 10, // beyond zlib levels, iterative optimal parsing
 		};
+		// order of code length code lengths in dynamic block header
+		static const size_t * code_length_order()
+		{
+			static const size_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+			return order;
+		}
+		// base length and extra bits of literal/length symbol 257..285
+		static const uint16_t * length_base()
+		{
+			static const uint16_t table[29] = {
+				3, 4, 5, 6, 7, 8, 9, 10, 11, 13,
+				15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+				67, 83, 99, 115, 131, 163, 195, 227, 258
+			};
+			return table;
+		}
+		static const uint8_t * length_extra_bits()
+		{
+			static const uint8_t table[29] = {
+				0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+				1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+				4, 4, 4, 4, 5, 5, 5, 5, 0
+			};
+			return table;
+		}
+		// base distance and extra bits of distance symbol 0..29
+		static const uint16_t * distance_base()
+		{
+			static const uint16_t table[30] = {
+				1, 2, 3, 4, 5, 7, 9, 13, 17, 25,
+				33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+				1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+			};
+			return table;
+		}
+		static const uint8_t * distance_extra_bits()
+		{
+			static const uint8_t table[30] = {
+				0, 0, 0, 0, 1, 1, 2, 2, 3, 3,
+				4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+				9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+			};
+			return table;
+		}
+		// literal/length symbol - 257 indexed by match length - 3
+		static const uint8_t * length_code()
+		{
+			static const uint8_t table[256] = {
+				0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+				12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15,
+				16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17,
+				18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19,
+				20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
+				21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+				22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+				23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+				24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+				24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+				25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+				25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+				26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+				26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+				27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+				27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 28
+			};
+			return table;
+		}
+		// distance symbol indexed by distance - 1 for distance <= 256, otherwise by 256 + ((distance - 1) >> 7)
+		static const uint8_t * distance_code()
+		{
+			static const uint8_t table[512] = {
+				0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+				8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+				10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+				11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+				12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+				12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+				13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+				13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+				14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+				14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+				14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+				14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+				15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+				15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+				15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+				15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+				0, 0, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+				22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+				24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+				25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+				26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+				26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+				27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+				27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+				28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+				28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+				28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+				28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+				29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+				29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+				29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+				29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29
+			};
+			return table;
+		}
+		// literal/length symbol and extra bits of match length
+		static literal_type length_symbol(size_t length, size_t& extra_bits, size_t& extra_data)
+		{
+			const size_t code = length_code()[length - MIN_LENGTH];
+			extra_bits = length_extra_bits()[code];
+			extra_data = length - length_base()[code];
+			return static_cast<literal_type>(END_OF_BLOCK + 1 + code);
+		}
+		// distance symbol and extra bits of match distance
+		static literal_type distance_symbol(size_t distance, size_t& extra_bits, size_t& extra_data)
+		{
+			const size_t code = distance_code()[distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+			extra_bits = distance_extra_bits()[code];
+			extra_data = distance - distance_base()[code];
+			return static_cast<literal_type>(code);
+		}
 		class huffman_codes{
 		public:
+			// decode table entry. first level is indexed by the next FAST_BITS bits of input,
+			// longer codes are linked to second level tables by sub_bits.
+			class table_entry{
+			public:
+				literal_type value; // literal or offset of second level table
+				uint8_t length; // consumed bits, 0 for invalid code
+				uint8_t sub_bits; // index bits of second level table, 0 for literal
+				table_entry()
+					: value(0)
+					, length(0)
+					, sub_bits(0)
+				{
+				}
+			};
 			std::vector<code_info> codes;
-			std::map<code_info, literal_type> table;
+			std::vector<table_entry> table;
+			size_t table_bits;
 			size_t min_length;
 			size_t max_length;
 			huffman_codes(size_t count)
 				: codes(count)
 				, table()
+				, table_bits(0)
 				, min_length(0)
 				, max_length(0)
 			{
@@ -68,8 +217,18 @@ namespace ccfrag{
 				codes.clear();
 				codes.resize(s);
 				table.clear();
+				table_bits = 0;
 				min_length = max_length = 0;
 			}
+			static code_type reverse_bits(code_type code, size_t length)
+			{
+				code_type result = 0;
+				for(size_t i = 0; i < length; ++i){
+					result = (result << 1) | (code & 1);
+					code >>= 1;
+				}
+				return result;
+			}
 			bool setup_table()
 			{
 				if(codes.empty()){
@@ -84,10 +243,9 @@ namespace ccfrag{
 					const auto& length = code.length;
 					min_length = (!min_length || !length) ? std::max(min_length, length) : std::min(min_length, length);
 					max_length = std::max(max_length, length);
-					if(length){
-						table[code] = i;
-					}
 				}
+				table.clear();
+				table_bits = 0;
 				if(max_length == 0 && max_length == 0){
 					return true;
 				}
@@ -95,13 +253,65 @@ namespace ccfrag{
 					fprintf(stderr, "invalid length %zd, %zd\n", min_length, max_length);
 					return false;
 				}
+				// input bits are read from LSB, so tables are indexed by bit reversed codes
+				table_bits = std::min<size_t>(max_length, FAST_BITS);
+				const size_t table_mask = (static_cast<size_t>(1) << table_bits) - 1;
+				table.resize(static_cast<size_t>(1) << table_bits);
+				std::vector<uint8_t> sub_bits(table.size(), 0);
+				for(literal_type i = 0; i < max_code; ++i){
+					const auto& code = codes[i];
+					if(table_bits < code.length){
+						auto& bits = sub_bits[reverse_bits(code.code, code.length) & table_mask];
+						bits = std::max<uint8_t>(bits, code.length - table_bits);
+					}
+				}
+				for(size_t i = 0; i < sub_bits.size(); ++i){
+					if(sub_bits[i]){
+						auto& entry = table[i];
+						entry.value = static_cast<literal_type>(table.size());
+						entry.length = static_cast<uint8_t>(table_bits);
+						entry.sub_bits = sub_bits[i];
+						table.resize(table.size() + (static_cast<size_t>(1) << sub_bits[i]));
+					}
+				}
+				for(literal_type i = 0; i < max_code; ++i){
+					const auto& code = codes[i];
+					const auto& length = code.length;
+					if(!length){
+						continue;
+					}
+					code_type reversed = reverse_bits(code.code, length);
+					size_t offset = 0;
+					size_t index = reversed;
+					size_t index_bits = length;
+					size_t fill_bits = table_bits;
+					if(table_bits < length){
+						const auto& link = table[reversed & table_mask];
+						offset = link.value;
+						index = reversed >> table_bits;
+						index_bits = length - table_bits;
+						fill_bits = link.sub_bits;
+					}
+					for(size_t fill = 0; fill < (static_cast<size_t>(1) << (fill_bits - index_bits)); ++fill){
+						auto& entry = table[offset + (index | (fill << index_bits))];
+						entry.value = i;
+						entry.length = static_cast<uint8_t>(index_bits);
+						entry.sub_bits = 0;
+					}
+				}
 				return true;
 			}
 			bool setup_tree()
+			{
+				return setup_codes() && setup_table();
+			}
+			// assign canonical codes from lengths
+			bool setup_codes()
 			{
 				const size_t max_code = codes.size();
 				// step1
-				std::map<size_t, size_t> bl_count;
+				size_t bl_count[MAX_BITS + 1] = {};
+				size_t used = 0;
 				for(size_t i = 0; i < max_code; ++i){
 					if(codes[i].length){
 						if(MAX_BITS < codes[i].length){
@@ -109,15 +319,15 @@ namespace ccfrag{
 							return false;
 						}
 						bl_count[codes[i].length]++;
+						++used;
 					}
 				}
-				if(bl_count.empty()){
-					return setup_table();//no entry is ok
+				if(!used){
+					return true;//no entry is ok
 				}
 				// step2
-				std::vector<code_type> next_code(MAX_BITS + 1, 0);
+				code_type next_code[MAX_BITS + 1] = {};
 				code_type code = 0;
-				bl_count[0] = 0;
 				for(int bits = 1; bits <= MAX_BITS; ++bits){
 					code = (code + bl_count[bits - 1]) << 1;
 					next_code[bits] = code;
@@ -128,17 +338,102 @@ namespace ccfrag{
 					auto length = code.length;
 					if(length){
 						code.code = next_code[length];
+						code.reversed = reverse_bits(code.code, length);
 						next_code[length]++;
 						if(code.code >> code.length){
-							for(auto it = bl_count.begin(), end = bl_count.end(); it != end; ++it){
-								fprintf(stderr, "bl_count[%zd]=%zd, next_code[%zd]=0x%zx\n", it->first, it->second, it->first, next_code[it->first]);
+							for(size_t bits = 1; bits <= MAX_BITS; ++bits){
+								if(bl_count[bits]){
+									fprintf(stderr, "bl_count[%zd]=%zd, next_code[%zd]=0x%zx\n", bits, bl_count[bits], bits, static_cast<size_t>(next_code[bits]));
+								}
 							}
 							fprintf(stderr, "overflow tree, code=0x%x len=%d\n", code.code, code.length);
 							return false;
 						}
 					}
 				}
-				return setup_table();
+				return true;
+			}
+			// build length limited huffman codes from symbol frequencies
+			bool setup_frequencies(const std::vector<size_t>& frequencies, size_t max_bits = MAX_BITS)
+			{
+				const size_t max_code = codes.size();
+				if(frequencies.size() < max_code || max_bits < 1 || MAX_BITS < max_bits){
+					return false;
+				}
+				clear();
+				std::vector<literal_type> symbols;
+				symbols.reserve(max_code);
+				for(literal_type i = 0; i < max_code; ++i){
+					if(frequencies[i]){
+						symbols.push_back(i);
+					}
+				}
+				// at least 2 codes are used for decoders which does not accept incomplete code
+				for(literal_type i = 0; symbols.size() < 2 && i < max_code; ++i){
+					if(!frequencies[i]){
+						symbols.push_back(i);
+					}
+				}
+				if(symbols.size() < 2){
+					return false;
+				}
+				// sort by frequency, last one is the most frequent
+				std::stable_sort(symbols.begin(), symbols.end(), [&frequencies](literal_type lhs, literal_type rhs){
+					return frequencies[lhs] < frequencies[rhs];
+				});
+				// huffman tree by two queues of sorted leaves and internal nodes
+				const size_t leaves = symbols.size();
+				std::vector<size_t> weights(leaves * 2 - 1);
+				std::vector<size_t> parents(leaves * 2 - 1, 0);
+				for(size_t i = 0; i < leaves; ++i){
+					weights[i] = frequencies[symbols[i]];
+				}
+				size_t leaf = 0;
+				size_t node = leaves;
+				for(size_t next = leaves; next < weights.size(); ++next){
+					size_t children[2];
+					for(size_t c = 0; c < 2; ++c){
+						if(leaf < leaves && (next <= node || weights[leaf] <= weights[node])){
+							children[c] = leaf++;
+						} else{
+							children[c] = node++;
+						}
+					}
+					weights[next] = weights[children[0]] + weights[children[1]];
+					parents[children[0]] = parents[children[1]] = next;
+				}
+				std::vector<size_t> depths(weights.size(), 0);
+				for(size_t i = weights.size() - 1; i--; ){
+					depths[i] = depths[parents[i]] + 1;
+				}
+				// limit lengths to max_bits, keep the code complete
+				std::vector<size_t> counts(max_bits + 1, 0);
+				for(size_t i = 0; i < leaves; ++i){
+					counts[std::min(depths[i], max_bits)]++;
+				}
+				uint64_t total = 0;
+				for(size_t bits = 1; bits <= max_bits; ++bits){
+					total += static_cast<uint64_t>(counts[bits]) << (max_bits - bits);
+				}
+				while(total != (static_cast<uint64_t>(1) << max_bits)){
+					counts[max_bits]--;
+					for(size_t bits = max_bits - 1; 0 < bits; --bits){
+						if(counts[bits]){
+							counts[bits]--;
+							counts[bits + 1] += 2;
+							break;
+						}
+					}
+					total--;
+				}
+				// shorter lengths for more frequent symbols
+				size_t index = leaves;
+				for(size_t bits = 1; bits <= max_bits; ++bits){
+					for(size_t n = counts[bits]; n; --n){
+						codes[symbols[--index]].length = bits;
+					}
+				}
+				return setup_codes();
 			}
 			bool setup_fixed_literal_length_table()
 			{
@@ -160,6 +455,9 @@ namespace ccfrag{
 					codes[i].code = 0xC0 + i - 280;			//11000000..11000111
 					codes[i].length = 8;
 				}
+				for(literal_type i = 0; i < max_code; ++i){
+					codes[i].reversed = reverse_bits(codes[i].code, codes[i].length);
+				}
 				return setup_table();
 			}
 			bool setup_fixed_distance_table()
@@ -171,6 +469,27 @@ namespace ccfrag{
 				}
 				return setup_tree();
 			}
+			// fixed codes are built once and shared by all encoders and decoders
+			static const huffman_codes& fixed_literal_length()
+			{
+				static const huffman_codes hc = build_fixed(MAX_LITERAL_CODE);
+				return hc;
+			}
+			static const huffman_codes& fixed_distance()
+			{
+				static const huffman_codes hc = build_fixed(MAX_DISTANCE_CODE);
+				return hc;
+			}
+			static huffman_codes build_fixed(size_t count)
+			{
+				huffman_codes hc(count);
+				if(count == MAX_LITERAL_CODE){
+					hc.setup_fixed_literal_length_table();
+				} else{
+					hc.setup_fixed_distance_table();
+				}
+				return hc;
+			}
 		};
 		class encoder{
 		public:
@@ -202,537 +521,1631 @@ namespace ccfrag{
 				}
 				size_t match(const input_type& target, size_t max_length) const
 				{
-					size_t length = 0;
 					max_length = std::min(max_length, std::min(size(), target.size()));
-					while(length < max_length){
-						if(begin[length] != target.begin[length]){
-							break;
+					// most candidates differ in first word
+					if(8 <= max_length){
+						uint64_t diff = bitstream::load_word(begin) ^ bitstream::load_word(target.begin);
+						if(diff){
+							return cpu::count_trailing_zeros(diff) / 8;
 						}
+					}
+					return match_kernel()(begin, target.begin, max_length);
+				}
+				typedef size_t (*match_kernel_type)(const char * lhs, const char * rhs, size_t max_length);
+				// length of common prefix by 8 bytes words, little endian xor finds first different byte
+				static size_t match_words(const char * lhs, const char * rhs, size_t max_length)
+				{
+					size_t length = 0;
+					for(; length + 8 <= max_length; length += 8){
+						uint64_t diff = bitstream::load_word(lhs + length) ^ bitstream::load_word(rhs + length);
+						if(diff){
+							return length + cpu::count_trailing_zeros(diff) / 8;
+						}
+					}
+					while(length < max_length && lhs[length] == rhs[length]){
 						++length;
 					}
 					return length;
 				}
+#ifdef CCFRAG_X86_64
+				// 16 bytes by compare and movemask, tail by words
+				static size_t match_sse2(const char * lhs, const char * rhs, size_t max_length)
+				{
+					size_t length = 0;
+					for(; length + 16 <= max_length; length += 16){
+						__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs + length));
+						__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs + length));
+						uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) ^ 0xFFFF;
+						if(mask){
+							return length + cpu::count_trailing_zeros(mask);
+						}
+					}
+					return length + match_words(lhs + length, rhs + length, max_length - length);
+				}
+				// 32 bytes by compare and movemask, tail by sse2
+				CCFRAG_TARGET("avx2")
+				static size_t match_avx2(const char * lhs, const char * rhs, size_t max_length)
+				{
+					size_t length = 0;
+					for(; length + 32 <= max_length; length += 32){
+						__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs + length));
+						__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs + length));
+						uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+						if(mask){
+							return length + cpu::count_trailing_zeros(mask);
+						}
+					}
+					return length + match_sse2(lhs + length, rhs + length, max_length - length);
+				}
+#endif
+				static match_kernel_type select_match_kernel()
+				{
+#ifdef CCFRAG_X86_64
+					if(cpu::has_avx2()){
+						return match_avx2;
+					}
+					return match_sse2;
+#else
+					return match_words;
+#endif
+				}
+				static match_kernel_type match_kernel()
+				{
+					static const match_kernel_type selected = select_match_kernel();
+					return selected;
+				}
 			};
-			class output_type{
+			class output_type : public bitstream::output_type{
 			public:
-				std::deque<char> output;
-				uint8_t byte;
-				size_t used_bits;
-				output_type()
-					: byte(0)
-					, used_bits(0)
+				bool write_code(const code_info& code)
 				{
+					return write(code.reversed, code.length);
 				}
-				template<typename T>
-				bool write(T write_data, size_t write_bits)
+				// length code, extra bits, distance code and extra bits in a write, at most 15 + 5 + 15 + 13 bits
+				bool write_match(const huffman_codes& literal_length_hc, const huffman_codes& distance_hc, size_t length, size_t distance)
 				{
-					if(32 < write_bits){
+					if(length < MIN_LENGTH || MAX_LENGTH < length || distance < MIN_DISTANCE || MAX_DISTANCE < distance){
 						return false;
 					}
-					static const uint8_t masks[9] = {0, 0x1, 0x3, 0x7, 0xF, 0x1F, 0x3F, 0x7F, 0xFF};
-					while(write_bits){
-						auto bits = std::min((8 - used_bits), write_bits);
-						byte |= (write_data & masks[bits]) << used_bits;
-						used_bits += bits;
-						write_bits -= bits;
-						write_data >>= bits;
-						if(used_bits == 8){
-							flush();
-						}
-					}
-					return true;
+					size_t length_extra_bits, length_extra_data, distance_extra_bits, distance_extra_data;
+					const auto& length_info = literal_length_hc.codes[length_symbol(length, length_extra_bits, length_extra_data)];
+					const auto& distance_info = distance_hc.codes[distance_symbol(distance, distance_extra_bits, distance_extra_data)];
+					uint64_t data = length_info.reversed;
+					size_t bits = length_info.length;
+					data |= static_cast<uint64_t>(length_extra_data) << bits;
+					bits += length_extra_bits;
+					data |= distance_info.reversed << bits;
+					bits += distance_info.length;
+					data |= static_cast<uint64_t>(distance_extra_data) << bits;
+					bits += distance_extra_bits;
+					return write(data, bits);
 				}
-				void flush()
+			};
+			enum strategy_type{
+				STRATEGY_DEFAULT, // matches searched in hash chains
+				STRATEGY_HUFFMAN_ONLY, // literals only
+				STRATEGY_RLE, // runs of a byte as matches of distance 1 only
+				STRATEGY_OPTIMAL, // shortest path of matches by cost model refined iteratively, blocks split by estimated size
+			};
+			// search parameters of match_finder
+			class parameters{
+			public:
+				size_t max_chain; // max count of searching hash chain
+				size_t good_length; // reduce searching chain when already found this length
+				size_t nice_length; // stop searching when found this length
+				size_t lazy_length; // lazy: do not search next position when found this length. greedy: do not insert hash of longer match
+				bool lazy; // lazy matching with one step lookahead, or greedy matching
+				strategy_type strategy;
+				size_t iterations; // cost model refinements of STRATEGY_OPTIMAL
+				parameters(size_t max_chain = 128, size_t good_length = 8, size_t nice_length = 128, size_t lazy_length = 16, bool lazy = true, strategy_type strategy = STRATEGY_DEFAULT, size_t iterations = 15)
+					: max_chain(max_chain)
+					, good_length(good_length)
+					, nice_length(nice_length)
+					, lazy_length(lazy_length)
+					, lazy(lazy)
+					, strategy(strategy)
+					, iterations(iterations)
+				{
+				}
+				// much slower than level 9 for smallest output, as zopfli
+				static parameters optimal(size_t iterations = 15)
 				{
-					if(used_bits){
-						output.push_back(byte);
-						used_bits = 0;
-						byte = 0;
+					return parameters(4096, 32, MAX_LENGTH, MAX_LENGTH, true, STRATEGY_OPTIMAL, iterations);
+				}
+				// compression level 1(fastest) .. 9(best) as zlib, or OPTIMAL_LEVEL
+				static parameters level(int level)
+				{
+					if(level == OPTIMAL_LEVEL){
+						return optimal();
 					}
+					static const parameters levels[MAX_LEVEL] = {
+						parameters(4, 4, 8, 4, false),
+						parameters(8, 4, 16, 5, false),
+						parameters(32, 4, 32, 6, false),
+						parameters(16, 4, 16, 4, true),
+						parameters(32, 8, 32, 16, true),
+						parameters(128, 8, 128, 16, true),
+						parameters(256, 8, 128, 32, true),
+						parameters(1024, 32, 258, 128, true),
+						parameters(4096, 32, 258, 258, true),
+					};
+					level = std::max<int>(MIN_LEVEL, std::min<int>(MAX_LEVEL, level));
+					return levels[level - MIN_LEVEL];
 				}
-				bool write_code(const code_info& code)
+			};
+			// literal or match
+			class token{
+			public:
+				uint16_t length; // 0 for literal
+				uint16_t value; // literal or distance
+				token(uint16_t length, uint16_t value)
+					: length(length)
+					, value(value)
 				{
-					for(size_t i = 0; i < code.length; ++i){
-						if(!write(((code.code >> (code.length - 1 - i)) & 1), 1)){
-							return false;
+				}
+			};
+			// hash chains of 3 bytes prefix in 32KiB window. positions are relative to base of input.
+			class match_finder{
+			public:
+				enum{
+					HASH_BITS = 15,
+					HASH_SIZE = 1 << HASH_BITS,
+					WINDOW_MASK = WINDOW_SIZE - 1,
+					NIL = 0xFFFFFFFF, // end of chain
+				};
+				parameters params;
+				std::vector<uint32_t> head;
+				std::vector<uint32_t> prev;
+				bool slid;
+				match_finder(const parameters& params)
+					: params(params)
+					, head(HASH_SIZE, NIL)
+					, prev(WINDOW_SIZE, NIL)
+					, slid(false)
+				{
+				}
+				static size_t hash(const char * p)
+				{
+					uint32_t value =
+						(static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 16) |
+						(static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 8) |
+						(static_cast<uint32_t>(static_cast<uint8_t>(p[2])));
+					return (value * 2654435761U) >> (32 - HASH_BITS);
+				}
+				// base[position..position+2] must be readable
+				void insert(const char * base, uint32_t position)
+				{
+					auto& h = head[hash(base + position)];
+					prev[position & WINDOW_MASK] = h;
+					h = position;
+				}
+				// search longest match before position, insert() position after this.
+				size_t find(const char * base, uint32_t position, size_t max_length, size_t& distance, size_t prev_length = 0) const
+				{
+					size_t best_length = prev_length;
+					if(max_length < MIN_LENGTH){
+						return 0;
+					}
+					const uint32_t limit = position < MAX_DISTANCE ? 0 : position - MAX_DISTANCE;
+					const input_type target(base + position, base + position + max_length);
+					const size_t nice_length = std::min(params.nice_length, max_length);
+					size_t chain = params.max_chain;
+					bool reduced = false;
+					uint32_t candidate = head[hash(base + position)];
+					while(candidate != NIL && limit <= candidate && chain){
+						if(!reduced && params.good_length <= best_length){
+							chain >>= 2;
+							reduced = true;
+							if(!chain){
+								break;
+							}
 						}
+						const char * src = base + candidate;
+						if(best_length < max_length && src[best_length] == target.begin[best_length] && src[0] == target.begin[0]){
+							size_t length = input_type(src, target.end).match(target, max_length);
+							if(best_length < length){
+								best_length = length;
+								distance = position - candidate;
+								if(nice_length <= length){
+									break;
+								}
+							}
+						}
+						--chain;
+						candidate = prev[candidate & WINDOW_MASK];
 					}
-					return true;
+					return best_length <= prev_length ? 0 : best_length;
 				}
-				bool write_length(const huffman_codes& hc, size_t length)
+				// append matches longer than previous ones in order of distance, so each is the closest for lengths up to it.
+				// returns the longest length within max_chain, insert() position after this.
+				size_t find_all(const char * base, uint32_t position, size_t max_length, std::vector<token>& matches) const
 				{
-					if(length < MIN_LENGTH || MAX_LENGTH < length){
-						return false;
+					size_t best_length = MIN_LENGTH - 1;
+					if(max_length < MIN_LENGTH){
+						return 0;
 					}
-					static const size_t value_table[6] = {257, 265, 269, 273, 277, 281};
-					static const size_t offsets[7] = {3, 11, 19, 35, 67, 131, 258};
-					literal_type value = 285;
-					size_t extra_bits = 0;
-					size_t extra_data = 0;
-					for(size_t i = 0; i < 6; ++i){
-						if(length < offsets[i+1]){
-							value = value_table[i] + (length - offsets[i]) / (1 << i);
-							extra_bits = i;
-							extra_data = (length - offsets[i]) % (1 << i);
-							break;
+					const uint32_t limit = position < MAX_DISTANCE ? 0 : position - MAX_DISTANCE;
+					const input_type target(base + position, base + position + max_length);
+					const size_t nice_length = std::min(params.nice_length, max_length);
+					size_t chain = params.max_chain;
+					bool reduced = false;
+					uint32_t candidate = head[hash(base + position)];
+					while(candidate != NIL && limit <= candidate && chain){
+						if(!reduced && params.good_length <= best_length){
+							chain >>= 2;
+							reduced = true;
+							if(!chain){
+								break;
+							}
 						}
+						const char * src = base + candidate;
+						if(src[best_length] == target.begin[best_length] && src[0] == target.begin[0]){
+							size_t length = input_type(src, target.end).match(target, max_length);
+							if(best_length < length){
+								best_length = length;
+								matches.push_back(token(static_cast<uint16_t>(length), static_cast<uint16_t>(position - candidate)));
+								if(nice_length <= length){
+									break;
+								}
+							}
+						}
+						--chain;
+						candidate = prev[candidate & WINDOW_MASK];
 					}
-					const auto& code = hc.codes[value];
-					if(!write_code(code)){
-						return false;
+					return MIN_LENGTH <= best_length ? best_length : 0;
+				}
+				void reset()
+				{
+					std::fill(head.begin(), head.end(), NIL);
+					std::fill(prev.begin(), prev.end(), NIL);
+					slid = false;
+				}
+				// forget positions inserted from base[0, size).
+				// prev is reached only from positions inserted after reset, so only head is cleared for short history.
+				void reset(const char * base, size_t size)
+				{
+					if(slid || HASH_SIZE / 4 < size){
+						reset();
+						return;
 					}
-					if(extra_bits && !write(extra_data, extra_bits)){
-						return false;
+					for(size_t position = 0; position + MIN_LENGTH <= size; ++position){
+						head[hash(base + position)] = NIL;
 					}
-					return true;
 				}
-				bool write_distance(const huffman_codes& hc, size_t distance)
+				// move base forward by count, count must be multiple of WINDOW_SIZE
+				void slide(uint32_t count)
 				{
-					if(distance < MIN_DISTANCE || MAX_DISTANCE < distance){
-						return false;
+					slid = true;
+					for(auto it = head.begin(), end = head.end(); it != end; ++it){
+						*it = (*it == NIL || *it < count) ? NIL : *it - count;
 					}
-					static const size_t value_table[14] = {0, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28};
-					static const size_t offsets[15] = {1, 5, 9, 17, 33, 65, 129, 257, 513, 1025, 2049, 4097, 8193, 16385, 32769};
-					literal_type value = 30;
-					size_t extra_bits = 0;
-					size_t extra_data = 0;
-					for(size_t i = 0; i < 14; ++i){
-						if(distance < offsets[i + 1]){
-							value = value_table[i] + (distance - offsets[i]) / (1 << i);
-							extra_bits = i;
-							extra_data = (distance - offsets[i]) % (1 << i);
-							break;
+					for(auto it = prev.begin(), end = prev.end(); it != end; ++it){
+						*it = (*it == NIL || *it < count) ? NIL : *it - count;
+					}
+				}
+			};
+			// tokens and symbol frequencies of a block
+			class block_type{
+			public:
+				const char * begin; // raw data for stored block
+				const char * end;
+				std::vector<token> tokens;
+				std::vector<size_t> literal_length_frequencies;
+				std::vector<size_t> distance_frequencies;
+				size_t extra_bits;
+				block_type(const char * begin = nullptr, const char * end = nullptr)
+					: begin(begin)
+					, end(end)
+					, literal_length_frequencies(MAX_LITERAL_CODE, 0)
+					, distance_frequencies(MAX_DISTANCE_CODE, 0)
+					, extra_bits(0)
+				{
+					literal_length_frequencies[END_OF_BLOCK] = 1;
+				}
+				// start block of [begin, end) without tokens, buffers are reused
+				void reset(const char * begin, const char * end)
+				{
+					this->begin = begin;
+					this->end = end;
+					tokens.clear();
+					std::fill(literal_length_frequencies.begin(), literal_length_frequencies.end(), 0);
+					std::fill(distance_frequencies.begin(), distance_frequencies.end(), 0);
+					literal_length_frequencies[END_OF_BLOCK] = 1;
+					extra_bits = 0;
+				}
+				size_t size() const
+				{
+					return end - begin;
+				}
+				void add_literal(uint8_t c)
+				{
+					tokens.push_back(token(0, c));
+					literal_length_frequencies[c]++;
+				}
+				void add(const token& t)
+				{
+					if(t.length){
+						add_match(t.length, t.value);
+					} else{
+						add_literal(static_cast<uint8_t>(t.value));
+					}
+				}
+				void add_match(size_t length, size_t distance)
+				{
+					tokens.push_back(token(static_cast<uint16_t>(length), static_cast<uint16_t>(distance)));
+					size_t bits, data;
+					literal_length_frequencies[length_symbol(length, bits, data)]++;
+					extra_bits += bits;
+					distance_frequencies[distance_symbol(distance, bits, data)]++;
+					extra_bits += bits;
+				}
+				// coded size of tokens
+				size_t data_bits(const huffman_codes& literal_length_hc, const huffman_codes& distance_hc) const
+				{
+					size_t bits = extra_bits;
+					for(size_t i = 0; i < MAX_LITERAL_CODE; ++i){
+						bits += literal_length_frequencies[i] * literal_length_hc.codes[i].length;
+					}
+					for(size_t i = 0; i < MAX_DISTANCE_CODE; ++i){
+						bits += distance_frequencies[i] * distance_hc.codes[i].length;
+					}
+					return bits;
+				}
+			};
+			// code lengths of dynamic block header in run length encoding
+			class code_lengths_type{
+			public:
+				size_t HLIT;
+				size_t HDIST;
+				size_t HCLEN;
+				std::vector<std::pair<uint8_t, uint8_t> > items; // symbol and extra data
+				huffman_codes hc_len;
+				std::vector<size_t> lengths;
+				std::vector<size_t> frequencies;
+				code_lengths_type()
+					: HLIT(0)
+					, HDIST(0)
+					, HCLEN(0)
+					, hc_len(19)
+					, frequencies(19, 0)
+				{
+				}
+				bool setup(const huffman_codes& literal_length_hc, const huffman_codes& distance_hc)
+				{
+					HLIT = MAX_LITERAL_CODE - 2; // 286, 287 are not used
+					while(257 < HLIT && !literal_length_hc.codes[HLIT - 1].length) --HLIT;
+					HDIST = MAX_DISTANCE_CODE - 2; // 30, 31 are not used
+					while(1 < HDIST && !distance_hc.codes[HDIST - 1].length) --HDIST;
+					lengths.clear();
+					for(size_t i = 0; i < HLIT; ++i){
+						lengths.push_back(literal_length_hc.codes[i].length);
+					}
+					for(size_t i = 0; i < HDIST; ++i){
+						lengths.push_back(distance_hc.codes[i].length);
+					}
+					items.clear();
+					std::fill(frequencies.begin(), frequencies.end(), 0);
+					for(size_t i = 0; i < lengths.size(); ){
+						const size_t length = lengths[i];
+						size_t run = 1;
+						while(i + run < lengths.size() && lengths[i + run] == length) ++run;
+						i += run;
+						if(!length){
+							while(11 <= run){
+								size_t count = std::min<size_t>(run, 138);
+								items.push_back(std::make_pair(18, static_cast<uint8_t>(count - 11)));
+								run -= count;
+							}
+							if(3 <= run){
+								items.push_back(std::make_pair(17, static_cast<uint8_t>(run - 3)));
+								run = 0;
+							}
+						} else{
+							items.push_back(std::make_pair(static_cast<uint8_t>(length), 0));
+							--run;
+							while(3 <= run){
+								size_t count = std::min<size_t>(run, 6);
+								items.push_back(std::make_pair(16, static_cast<uint8_t>(count - 3)));
+								run -= count;
+							}
+						}
+						for(; run; --run){
+							items.push_back(std::make_pair(static_cast<uint8_t>(length), 0));
 						}
 					}
-					if(value == 30){
-						return false;
+					for(auto it = items.begin(), end = items.end(); it != end; ++it){
+						frequencies[it->first]++;
 					}
-					const auto& code = hc.codes[value];
-					if(!write_code(code)){
+					if(!hc_len.setup_frequencies(frequencies, 7)){
 						return false;
 					}
-					if(extra_bits && !write(extra_data, extra_bits)){
+					const size_t * order = code_length_order();
+					HCLEN = 19;
+					while(4 < HCLEN && !hc_len.codes[order[HCLEN - 1]].length) --HCLEN;
+					return true;
+				}
+				static size_t item_extra_bits(uint8_t symbol)
+				{
+					return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0;
+				}
+				size_t bits() const
+				{
+					size_t bits = 5 + 5 + 4 + 3 * HCLEN;
+					for(auto it = items.begin(), end = items.end(); it != end; ++it){
+						bits += hc_len.codes[it->first].length + item_extra_bits(it->first);
+					}
+					return bits;
+				}
+				bool write(output_type& out) const
+				{
+					if(!out.write(HLIT - 257, 5) || !out.write(HDIST - 1, 5) || !out.write(HCLEN - 4, 4)){
 						return false;
 					}
+					const size_t * order = code_length_order();
+					for(size_t i = 0; i < HCLEN; ++i){
+						if(!out.write(hc_len.codes[order[i]].length, 3)){
+							return false;
+						}
+					}
+					for(auto it = items.begin(), end = items.end(); it != end; ++it){
+						if(!out.write_code(hc_len.codes[it->first])){
+							return false;
+						}
+						size_t extra_bits = item_extra_bits(it->first);
+						if(extra_bits && !out.write(it->second, extra_bits)){
+							return false;
+						}
+					}
 					return true;
 				}
 			};
-			static bool encode(std::vector<char>& output, const std::vector<char>& input)
+			// dynamic huffman codes of a block and their header, rebuilt for each block
+			class dynamic_codes{
+			public:
+				huffman_codes literal_length_hc;
+				huffman_codes distance_hc;
+				code_lengths_type code_lengths;
+				dynamic_codes()
+					: literal_length_hc(MAX_LITERAL_CODE)
+					, distance_hc(MAX_DISTANCE_CODE)
+				{
+				}
+				bool setup(const block_type& block)
+				{
+					return literal_length_hc.setup_frequencies(block.literal_length_frequencies) &&
+						distance_hc.setup_frequencies(block.distance_frequencies) &&
+						code_lengths.setup(literal_length_hc, distance_hc);
+				}
+				// coded size of block with header, without BFINAL and BTYPE
+				size_t bits(const block_type& block) const
+				{
+					return code_lengths.bits() + block.data_bits(literal_length_hc, distance_hc);
+				}
+			};
+			// block.size() <= MAX_BLOCK_SIZE
+			static bool write_stored(output_type& out, const block_type& block, bool final)
 			{
-				input_type in(input.data(), input.data() + input.size());
-				output_type out;
-				huffman_codes fixed_literal_length_hc(MAX_LITERAL_CODE);
-				huffman_codes fixed_distance_hc(MAX_DISTANCE_CODE);
-				if(!fixed_literal_length_hc.setup_fixed_literal_length_table()){
+				uint8_t BFINAL = (final ? 1 : 0);
+				uint16_t LEN = static_cast<uint16_t>(block.size());
+				uint16_t NLEN = ~LEN;
+				if(!out.write(BFINAL, 1) || !out.write(BTYPE_NO_COMPRESSION, 2)){
 					return false;
 				}
-				if(!fixed_distance_hc.setup_fixed_distance_table()){
+				out.flush();
+				return out.write(LEN, 16) && out.write(NLEN, 16) && out.write_bytes(block.begin, block.size());
+			}
+			static bool write_tokens(output_type& out, const block_type& block, const huffman_codes& literal_length_hc, const huffman_codes& distance_hc)
+			{
+				for(auto it = block.tokens.begin(), end = block.tokens.end(); it != end; ++it){
+					if(it->length){
+						if(!out.write_match(literal_length_hc, distance_hc, it->length, it->value)){
+							return false;
+						}
+					} else if(!out.write_code(literal_length_hc.codes[it->value])){
+						return false;
+					}
+				}
+				return out.write_code(literal_length_hc.codes[END_OF_BLOCK]);
+			}
+			// write a block in the smallest of stored, fixed and dynamic huffman codes
+			static bool write_block(output_type& out, const block_type& block, bool final, dynamic_codes& codes)
+			{
+				if(!codes.setup(block)){
 					return false;
 				}
-				std::map<uint32_t, std::set<size_t> > last_pattern;
-				while(!in.empty()){
-					input_type block(in.begin, in.begin + std::min<size_t>(in.size(), MAX_BLOCK_SIZE));
-					in.advance(block.size());
-					uint8_t BFINAL = (in.empty() ? 1 : 0);
-					uint8_t BTYPE = BTYPE_FIXED_HUFFMAN_CODES;
-					out.write(BFINAL, 1);
-					out.write(BTYPE, 2);
-					while(!block.empty()){
-						size_t offset_from_start = block.begin - input.data();
-						size_t reference_start = offset_from_start < MAX_DISTANCE ? 0 : offset_from_start - MAX_DISTANCE;
-						bool wrote = false;
-						if(3 <= block.size() || 3 <= in.end - block.begin){
-							uint32_t start_code = 
-								(static_cast<uint8_t>(block.begin[0]) << 16) |
-								(static_cast<uint8_t>(block.begin[1]) << 8) |
-								(static_cast<uint8_t>(block.begin[2]));
-							auto it = last_pattern.find(start_code);
-							if(3 <= block.size() && it != last_pattern.end()){
-								auto& patterns = it->second;
-								size_t best_distance = 0;
-								size_t best_length = 0;
-								for(auto pit = patterns.begin(); pit != patterns.end();){
-									size_t position = *pit;
-									if(reference_start <= position){
-										uint32_t distance = offset_from_start - position;
-										input_type src(input.data() + position, in.end);
-										size_t length = src.match(block, MAX_LENGTH);
-										if(best_length < length){
-											best_length = length;
-											best_distance = distance;
-										}
-										++pit;
-									}else{
-										pit = patterns.erase(pit);
-									}
-								}
-								if(3 <= best_length){
-									block.advance(best_length);
-									if(!out.write_length(fixed_literal_length_hc, best_length)){
-										return false;
-									}
-									if(!out.write_distance(fixed_distance_hc, best_distance)){
-										return false;
-									}
-									wrote = true;
-								}
-								patterns.insert(offset_from_start);
-							}else{
-								last_pattern[start_code].insert(offset_from_start);
+				const huffman_codes& fixed_literal_length_hc = huffman_codes::fixed_literal_length();
+				const huffman_codes& fixed_distance_hc = huffman_codes::fixed_distance();
+				const size_t fixed_bits = block.data_bits(fixed_literal_length_hc, fixed_distance_hc);
+				const size_t dynamic_bits = codes.bits(block);
+				const size_t padding_bits = (8 - (out.bit_count + 3) % 8) % 8;
+				const size_t stored_bits = block.size() <= MAX_BLOCK_SIZE ? padding_bits + 32 + block.size() * 8 : ~static_cast<size_t>(0);
+				uint8_t BFINAL = (final ? 1 : 0);
+				if(stored_bits < fixed_bits && stored_bits < dynamic_bits){
+					return write_stored(out, block, final);
+				}
+				if(fixed_bits <= dynamic_bits){
+					return out.write(BFINAL, 1) &&
+						out.write(BTYPE_FIXED_HUFFMAN_CODES, 2) &&
+						write_tokens(out, block, fixed_literal_length_hc, fixed_distance_hc);
+				}
+				return out.write(BFINAL, 1) &&
+					out.write(BTYPE_DYNAMIC_HUFFMAN_CODES, 2) &&
+					codes.code_lengths.write(out) &&
+					write_tokens(out, block, codes.literal_length_hc, codes.distance_hc);
+			}
+			// split block into literals and matches, matches do not cross the end of block
+			static void find_matches(block_type& block, match_finder& finder, const char * base, const char * input_end)
+			{
+				// 3 bytes match with far distance is not smaller than literals
+				static const size_t too_far = 4096;
+				const parameters& params = finder.params;
+				const char * p = block.begin;
+				size_t prev_length = 0;
+				size_t prev_distance = 0;
+				bool literal_available = false;
+				while(p < block.end){
+					const uint32_t position = static_cast<uint32_t>(p - base);
+					size_t length = 0;
+					size_t distance = 0;
+					if(MIN_LENGTH <= static_cast<size_t>(input_end - p)){
+						if(!params.lazy || prev_length < params.lazy_length){
+							length = finder.find(base, position, std::min<size_t>(block.end - p, MAX_LENGTH), distance, params.lazy ? prev_length : 0);
+							if(length == MIN_LENGTH && too_far < distance){
+								length = 0;
 							}
 						}
-						if(!wrote){
-							uint8_t data = static_cast<uint8_t>(*block.begin);
-							block.advance(1);
-							auto& code = fixed_literal_length_hc.codes[data];
-							if(!out.write_code(code)){
-								return false;
+						finder.insert(base, position);
+					}
+					if(!params.lazy){
+						if(MIN_LENGTH <= length){
+							block.add_match(length, distance);
+							if(length <= params.lazy_length){
+								for(const char * q = p + 1; q < p + length && MIN_LENGTH <= static_cast<size_t>(input_end - q); ++q){
+									finder.insert(base, static_cast<uint32_t>(q - base));
+								}
 							}
+							p += length;
+						} else{
+							block.add_literal(static_cast<uint8_t>(*p));
+							++p;
 						}
+						continue;
 					}
-					if(!out.write_code(fixed_literal_length_hc.codes[END_OF_BLOCK])){
-						return false;
+					if(MIN_LENGTH <= prev_length && length <= prev_length){
+						// previous match starts from p - 1
+						block.add_match(prev_length, prev_distance);
+						for(const char * q = p + 1; q < p - 1 + prev_length && MIN_LENGTH <= static_cast<size_t>(input_end - q); ++q){
+							finder.insert(base, static_cast<uint32_t>(q - base));
+						}
+						p += prev_length - 1;
+						prev_length = 0;
+						literal_available = false;
+					} else{
+						if(literal_available){
+							block.add_literal(static_cast<uint8_t>(p[-1]));
+						}
+						literal_available = true;
+						prev_length = length;
+						prev_distance = distance;
+						++p;
 					}
 				}
-				out.flush();
-				output.assign(out.output.begin(), out.output.end());
-				return true;
+				if(literal_available){
+					block.add_literal(static_cast<uint8_t>(p[-1]));
+				}
 			}
-		};
-		class decoder{
-		public:
-			class input_type{
+			// literals only, for data without repeated strings
+			static void find_literals(block_type& block)
+			{
+				for(const char * p = block.begin; p < block.end; ++p){
+					block.add_literal(static_cast<uint8_t>(*p));
+				}
+			}
+			// runs of the previous byte as matches of distance 1, runs do not start before block
+			static void find_runs(block_type& block)
+			{
+				const char * p = block.begin;
+				while(p < block.end){
+					size_t length = 0;
+					if(block.begin < p){
+						length = input_type(p - 1, block.end).match(input_type(p, block.end), MAX_LENGTH);
+					}
+					if(MIN_LENGTH <= length){
+						block.add_match(length, 1);
+						p += length;
+					} else{
+						block.add_literal(static_cast<uint8_t>(*p));
+						++p;
+					}
+				}
+			}
+			// coded bits of block in the smallest of stored, fixed and dynamic huffman codes, without padding
+			static size_t block_bits(const block_type& block, dynamic_codes& codes)
+			{
+				size_t bits = block.size() <= MAX_BLOCK_SIZE ? 3 + 32 + block.size() * 8 : ~static_cast<size_t>(0);
+				bits = std::min(bits, 3 + block.data_bits(huffman_codes::fixed_literal_length(), huffman_codes::fixed_distance()));
+				if(codes.setup(block)){
+					bits = std::min(bits, 3 + codes.bits(block));
+				}
+				return bits;
+			}
+			// blocks of STRATEGY_OPTIMAL.
+			// matches of every position are searched once, blocks are split by estimated bits of greedy parse,
+			// then each block is parsed as shortest path in bits by symbol costs of previous parse.
+			// buffers are kept in encoder and reused for following blocks.
+			class optimal_parser{
 			public:
+				enum{
+					MIN_SPLIT_TOKENS = 512,
+					SPLIT_SAMPLES = 9,
+					MAX_SPLITS = 15,
+				};
 				const char * begin;
-				const char * end;
-				size_t used_bits;
-				input_type(const input_type& rhs)
-					: begin(rhs.begin)
-					, end(rhs.end)
-					, used_bits(rhs.used_bits)
+				size_t size;
+				std::vector<token> matches; // closest matches for increasing lengths
+				std::vector<uint32_t> offsets; // matches of position i are [offsets[i], offsets[i + 1])
+				std::vector<token> tokens; // greedy parse
+				std::vector<uint32_t> starts; // position of each token and size
+				std::vector<float> literal_length_costs;
+				std::vector<float> distance_costs;
+				std::vector<float> costs; // shortest path to each position
+				std::vector<token> steps; // last token to each position
+				std::vector<token> path;
+				block_type greedy; // for estimate of split
+				block_type best;
+				block_type previous;
+				block_type current;
+				optimal_parser()
+					: begin(nullptr)
+					, size(0)
+					, literal_length_costs(MAX_LITERAL_CODE)
+					, distance_costs(MAX_DISTANCE_CODE)
 				{
 				}
-				input_type(const char* begin, const char* end)
-					: begin(begin)
-					, end(end)
-					, used_bits(0)
+				// find matches of every position in [begin, end) and parse them greedily
+				void setup(match_finder& finder, const char * base, const char * begin, const char * end, const char * input_end)
 				{
+					this->begin = begin;
+					size = end - begin;
+					matches.clear();
+					offsets.assign(size + 1, 0);
+					tokens.clear();
+					starts.clear();
+					for(size_t i = 0; i < size; ++i){
+						const char * p = begin + i;
+						offsets[i] = static_cast<uint32_t>(matches.size());
+						if(MIN_LENGTH <= static_cast<size_t>(input_end - p)){
+							finder.find_all(base, static_cast<uint32_t>(p - base), std::min<size_t>(end - p, MAX_LENGTH), matches);
+							finder.insert(base, static_cast<uint32_t>(p - base));
+						}
+					}
+					offsets[size] = static_cast<uint32_t>(matches.size());
+					for(size_t i = 0; i < size;){
+						starts.push_back(static_cast<uint32_t>(i));
+						if(offsets[i] != offsets[i + 1]){
+							tokens.push_back(matches[offsets[i + 1] - 1]);
+							i += tokens.back().length;
+						} else{
+							tokens.push_back(token(0, static_cast<uint8_t>(begin[i])));
+							++i;
+						}
+					}
+					starts.push_back(static_cast<uint32_t>(size));
 				}
-				bool empty() const
+				// greedy tokens in [first, last)
+				void greedy_block(size_t first, size_t last, block_type& block) const
 				{
-					return end <= begin;
+					block.reset(begin + starts[first], begin + starts[last]);
+					for(size_t k = first; k < last; ++k){
+						block.add(tokens[k]);
+					}
 				}
-				size_t size() const
+				size_t greedy_bits(size_t first, size_t last, dynamic_codes& codes)
 				{
-					return empty() ? 0 : (end - begin) * 8 - used_bits;
+					greedy_block(first, last, greedy);
+					return block_bits(greedy, codes);
 				}
-				void advance(size_t count)
+				// token indices splitting [first, last) into blocks of fewer bits.
+				// the best split point is searched by samples narrowed around the best sample.
+				void split(size_t first, size_t last, std::vector<size_t>& splits, dynamic_codes& codes)
 				{
-					used_bits += count;
-					begin += used_bits / 8;
-					used_bits %= 8;
+					if(MAX_SPLITS <= splits.size() || last - first < MIN_SPLIT_TOKENS * 2){
+						return;
+					}
+					size_t low = first + MIN_SPLIT_TOKENS;
+					size_t high = last - MIN_SPLIT_TOKENS;
+					size_t best = low;
+					size_t best_bits = ~static_cast<size_t>(0);
+					while(true){
+						const size_t step = std::max<size_t>(1, (high - low) / SPLIT_SAMPLES);
+						for(size_t k = low; k <= high; k += step){
+							size_t bits = greedy_bits(first, k, codes) + greedy_bits(k, last, codes);
+							if(bits < best_bits){
+								best_bits = bits;
+								best = k;
+							}
+						}
+						if(step == 1){
+							break;
+						}
+						low = best < low + step ? low : best - step + 1;
+						high = high < best + step ? high : best + step - 1;
+					}
+					if(greedy_bits(first, last, codes) <= best_bits){
+						return;
+					}
+					splits.push_back(best);
+					split(first, best, splits, codes);
+					split(best, last, splits, codes);
 				}
-				void skip_to_byte_align()
+				// shortest path of [first, last) positions, costs in bits are estimated from symbol frequencies of estimate block
+				void parse(size_t first, size_t last, const block_type& estimate, block_type& block)
 				{
-					if(used_bits){
-						++begin;
-						used_bits = 0;
+					const size_t n = last - first;
+					symbol_costs(literal_length_costs, estimate.literal_length_frequencies);
+					symbol_costs(distance_costs, estimate.distance_frequencies);
+					float length_costs[MAX_LENGTH + 1] = {};
+					for(size_t length = MIN_LENGTH; length <= MAX_LENGTH; ++length){
+						size_t bits, data;
+						size_t symbol = length_symbol(length, bits, data);
+						length_costs[length] = literal_length_costs[symbol] + bits;
+					}
+					costs.assign(n + 1, std::numeric_limits<float>::infinity());
+					steps.assign(n + 1, token(0, 0));
+					costs[0] = 0;
+					for(size_t i = 0; i < n; ++i){
+						const size_t position = first + i;
+						const float cost = costs[i];
+						const float literal_cost = cost + literal_length_costs[static_cast<uint8_t>(begin[position])];
+						if(literal_cost < costs[i + 1]){
+							costs[i + 1] = literal_cost;
+							steps[i + 1] = token(0, static_cast<uint8_t>(begin[position]));
+						}
+						const size_t max_length = std::min<size_t>(n - i, MAX_LENGTH);
+						size_t length = MIN_LENGTH;
+						for(uint32_t m = offsets[position]; m < offsets[position + 1] && length <= max_length; ++m){
+							const token& match = matches[m];
+							size_t bits, data;
+							size_t symbol = distance_symbol(match.value, bits, data);
+							const float match_cost = cost + distance_costs[symbol] + bits;
+							for(const size_t end = std::min<size_t>(match.length, max_length); length <= end; ++length){
+								const float c = match_cost + length_costs[length];
+								if(c < costs[i + length]){
+									costs[i + length] = c;
+									steps[i + length] = token(static_cast<uint16_t>(length), match.value);
+								}
+							}
+						}
+					}
+					path.clear();
+					for(size_t i = n; i; i -= std::max<size_t>(1, steps[i].length)){
+						path.push_back(steps[i]);
+					}
+					block.reset(begin + first, begin + last);
+					for(auto it = path.rbegin(), end = path.rend(); it != end; ++it){
+						block.add(*it);
 					}
 				}
-				// not for huffman codes
-				template<typename T>
-				bool read(T& data, size_t read_bits)
+				// -log2 of probability, unused symbols cost more than any used one
+				static void symbol_costs(std::vector<float>& costs, const std::vector<size_t>& frequencies)
 				{
-					if(sizeof(T) * 8 < read_bits || size() < read_bits){
-						return false;
+					size_t total = 0;
+					for(size_t i = 0; i < costs.size(); ++i){
+						total += frequencies[i];
 					}
-					data = 0;
-					size_t shift = 0;
-					static const uint8_t masks[9] = {0, 0x1, 0x3, 0x7, 0xF, 0x1F, 0x3F, 0x7F, 0xFF};
-					while(read_bits){
-						auto bits = std::min((8 - used_bits), read_bits);
-						data |= static_cast<T>(((static_cast<uint8_t>(*begin) >> used_bits) & masks[bits])) << shift;
-						shift += bits;
-						read_bits -= bits;
-						advance(bits);
+					const float total_bits = std::log2(static_cast<float>(std::max<size_t>(total, 1)));
+					for(size_t i = 0; i < costs.size(); ++i){
+						costs[i] = frequencies[i] ? total_bits - std::log2(static_cast<float>(frequencies[i])) : total_bits + 1;
 					}
-					return true;
 				}
-				template<typename T>
-				bool read_literal(T& value, const huffman_codes& hc)
+				// split blocks and refine each block iterations times, keeping the smallest parse
+				bool write(output_type& out, size_t iterations, bool final, dynamic_codes& codes)
 				{
-					size_t min_length = hc.min_length;
-					size_t max_length = hc.max_length;
-					auto& table = hc.table;
-					code_info code;
-					code.length = min_length;
-					for(size_t i = 0; i < min_length; ++i){
-						uint8_t c;
-						if(!read(c, 1)){
-							fprintf(stderr, "not enough length %zd\n", i);
+					std::vector<size_t> splits;
+					split(0, tokens.size(), splits, codes);
+					splits.push_back(0);
+					splits.push_back(tokens.size());
+					std::sort(splits.begin(), splits.end());
+					for(size_t b = 0; b + 1 < splits.size(); ++b){
+						const size_t first = starts[splits[b]];
+						const size_t last = starts[splits[b + 1]];
+						greedy_block(splits[b], splits[b + 1], best);
+						size_t best_bits = block_bits(best, codes);
+						previous = best;
+						size_t previous_bits = best_bits;
+						for(size_t i = 0; i < iterations; ++i){
+							parse(first, last, previous, current);
+							const size_t bits = block_bits(current, codes);
+							if(bits < best_bits){
+								best = current;
+								best_bits = bits;
+							} else if(bits == previous_bits){
+								break; // converged
+							}
+							std::swap(previous, current);
+							previous_bits = bits;
+						}
+						if(!write_block(out, best, final && b + 2 == splits.size(), codes)){
+							return false;
+						}
+					}
+					return true;
+				}
+			};
+			// few 4 bytes sequences repeat in block and order-0 entropy of block is close to 8 bits per byte.
+			// neither matches nor huffman codes would make such block smaller than stored.
+			// repeats are probed first as they are found soon in compressible data.
+			static bool incompressible(const char * begin, const char * end)
+			{
+				enum{
+					MIN_CHECK_SIZE = 16384, // entropy of smaller sample is underestimated
+					MIN_ENTROPY_PERMILLE = 7950, // bits per byte * 1000
+					PROBE_BITS = 12,
+					MAX_REPEAT_RATIO = 64, // repeats at 1/64 of positions are worth matching
+				};
+				const size_t size = end - begin;
+				if(size < MIN_CHECK_SIZE){
+					return false;
+				}
+				// last position + 1 of hashed 4 bytes
+				uint32_t last[1 << PROBE_BITS] = {};
+				size_t repeats = 0;
+				for(const char * p = begin; p + 4 <= end; ++p){
+					uint32_t value;
+					memcpy(&value, p, sizeof(value));
+					uint32_t& entry = last[(value * 2654435761U) >> (32 - PROBE_BITS)];
+					if(entry && !memcmp(begin + entry - 1, p, 4) && size / MAX_REPEAT_RATIO < ++repeats){
+						return false;
+					}
+					entry = static_cast<uint32_t>(p - begin + 1);
+				}
+				size_t counts[256] = {};
+				for(const char * p = begin; p != end; ++p){
+					++counts[static_cast<uint8_t>(*p)];
+				}
+				double bits = 0;
+				for(size_t c = 0; c < 256; ++c){
+					if(counts[c]){
+						bits -= counts[c] * std::log2(static_cast<double>(counts[c]) / size);
+					}
+				}
+				return static_cast<double>(size) * MIN_ENTROPY_PERMILLE <= bits * 1000;
+			}
+			enum flush_type{
+				NO_FLUSH, // keep input until a block is filled
+				SYNC_FLUSH, // write pending input and an empty stored block to align output to byte boundary
+				FULL_FLUSH, // SYNC_FLUSH and forget history, following output is decodable without preceding output
+				FINISH, // write pending input as the final block
+			};
+			parameters params;
+			match_finder finder;
+			output_type out;
+			std::vector<char> window; // history (up to 4 * WINDOW_SIZE) and pending input
+			size_t processed; // size of history in window
+			size_t backlog; // last positions of history not inserted yet, as fewer than MIN_LENGTH bytes followed them
+			bool finished;
+			// per block state, cleared for each block and reused
+			block_type block;
+			dynamic_codes codes;
+			optimal_parser parser;
+			encoder(const parameters& params = parameters())
+				: params(params)
+				, finder(params)
+				, processed(0)
+				, backlog(0)
+				, finished(false)
+			{
+			}
+			// start a new stream, buffers and hash tables are reused
+			void reset()
+			{
+				finder.reset(window.data(), window.size());
+				out.output.clear();
+				out.bits = 0;
+				out.bit_count = 0;
+				window.clear();
+				processed = 0;
+				backlog = 0;
+				finished = false;
+			}
+			size_t pending() const
+			{
+				return window.size() - processed;
+			}
+			// use last WINDOW_SIZE bytes of data as history before first write
+			bool set_dictionary(const char * data, size_t size)
+			{
+				if(finished || !window.empty()){
+					return false;
+				}
+				if(WINDOW_SIZE < size){
+					data += size - WINDOW_SIZE;
+					size = WINDOW_SIZE;
+				}
+				window.assign(data, data + size);
+				for(uint32_t position = 0; position + MIN_LENGTH <= size; ++position){
+					finder.insert(window.data(), position);
+				}
+				processed = size;
+				backlog = std::min<size_t>(size, MIN_LENGTH - 1);
+				return true;
+			}
+			// compress input and append output, output is not complete until flush
+			bool write(std::vector<char>& output, const char * data, size_t size, flush_type flush = NO_FLUSH)
+			{
+				if(finished){
+					return false;
+				}
+				do{
+					size_t count = std::min<size_t>(size, MAX_BLOCK_SIZE);
+					window.insert(window.end(), data, data + count);
+					data += count;
+					size -= count;
+					while(MAX_BLOCK_SIZE < pending() || (MAX_BLOCK_SIZE == pending() && (size || flush == NO_FLUSH))){
+						if(!compress_block(MAX_BLOCK_SIZE, false)){
 							return false;
 						}
-						code.code <<= 1;
-						code.code |= c;
 					}
-					auto it = table.find(code);
-					while(it == table.end()){
-						if(code.length >= max_length){
-							fprintf(stderr, "overflow length=%zd code=%zx, size=%zd\n", code.length, code.code, table.size());
+				} while(size);
+				if(flush != NO_FLUSH){
+					if((pending() || flush == FINISH) && !compress_block(pending(), flush == FINISH)){
+						return false;
+					}
+					if(flush == FINISH){
+						finished = true;
+					} else{
+						// empty stored block
+						if(!out.write(0, 1) || !out.write(BTYPE_NO_COMPRESSION, 2)){
 							return false;
 						}
-						uint8_t c = 0;
-						if(!read(c, 1)){
-							fprintf(stderr, "not enough length %zd\n", code.length);
+						out.flush();
+						if(!out.write(0x0000, 16) || !out.write(0xFFFF, 16)){
 							return false;
 						}
-						code.code <<= 1;
-						code.code |= c;
-						++code.length;
-						it = table.find(code);
+						if(flush == FULL_FLUSH){
+							finder.reset();
+							backlog = 0;
+						}
+					}
+					out.flush();
+				}
+				output.insert(output.end(), out.output.begin(), out.output.end());
+				out.output.clear();
+				return true;
+			}
+			bool finish(std::vector<char>& output)
+			{
+				return write(output, nullptr, 0, FINISH);
+			}
+			// compress size bytes of pending input as a block
+			bool compress_block(size_t size, bool final)
+			{
+				if(WINDOW_SIZE * 4 < processed){
+					uint32_t count = static_cast<uint32_t>((processed - WINDOW_SIZE) & ~static_cast<size_t>(WINDOW_SIZE - 1));
+					window.erase(window.begin(), window.begin() + count);
+					finder.slide(count);
+					processed -= count;
+				}
+				const char * base = window.data();
+				const char * input_end = base + window.size();
+				// insert backlog as input follows it, positions from limit are left for the next block
+				const size_t limit = MIN_LENGTH <= window.size() ? window.size() - MIN_LENGTH + 1 : 0;
+				for(; backlog && processed - backlog < limit; --backlog){
+					finder.insert(base, static_cast<uint32_t>(processed - backlog));
+				}
+				block.reset(base + processed, base + processed + size);
+				processed += size;
+				backlog = limit < processed ? processed - limit : 0;
+				if(incompressible(block.begin, block.end)){
+					// stored without searching, positions in reach of following blocks are inserted for their matches
+					if(params.strategy == STRATEGY_DEFAULT || params.strategy == STRATEGY_OPTIMAL){
+						for(const char * p = block.size() < WINDOW_SIZE ? block.begin : block.end - WINDOW_SIZE; p < block.end && MIN_LENGTH <= static_cast<size_t>(input_end - p); ++p){
+							finder.insert(base, static_cast<uint32_t>(p - base));
+						}
+					}
+					return write_stored(out, block, final);
+				}
+				switch(params.strategy){
+				case STRATEGY_HUFFMAN_ONLY:
+					find_literals(block);
+					break;
+				case STRATEGY_RLE:
+					find_runs(block);
+					break;
+				case STRATEGY_OPTIMAL:
+					parser.setup(finder, base, block.begin, block.end, input_end);
+					return parser.write(out, params.iterations, final, codes);
+				default:
+					find_matches(block, finder, base, input_end);
+					break;
+				}
+				return write_block(out, block, final, codes);
+			}
+			static bool encode(std::vector<char>& output, const std::vector<char>& input, const parameters& params = parameters(), const std::vector<char>& dictionary = std::vector<char>())
+			{
+				encoder e(params);
+				output.clear();
+				if(!dictionary.empty() && !e.set_dictionary(dictionary.data(), dictionary.size())){
+					return false;
+				}
+				return e.write(output, input.data(), input.size(), FINISH);
+			}
+		};
+		class decoder{
+		public:
+			typedef std::function<bool(const char * data, size_t size)> output_function;
+			typedef std::function<bool(const decoder& d)> block_function;
+			class input_type : public bitstream::input_type{
+			public:
+				input_type()
+					: bitstream::input_type(nullptr, nullptr)
+				{
+				}
+				input_type(const char* begin, const char* end)
+					: bitstream::input_type(begin, end)
+				{
+				}
+				// fail on invalid code or not enough input.
+				// not enough input if bit_count < hc.max_length after failure.
+				template<typename T>
+				bool read_literal(T& value, const huffman_codes& hc)
+				{
+					auto& table = hc.table;
+					if(table.empty()){
+						return false;
 					}
-					value = it->second;
+					size_t bits = static_cast<size_t>(peek(hc.max_length));
+					auto entry = table[bits & ((static_cast<size_t>(1) << hc.table_bits) - 1)];
+					size_t length = entry.length;
+					if(entry.sub_bits){
+						entry = table[entry.value + ((bits >> length) & ((static_cast<size_t>(1) << entry.sub_bits) - 1))];
+						length += entry.length;
+					}
+					if(!entry.length || bit_count < length){
+						return false;
+					}
+					advance(length);
+					value = entry.value;
 					return true;
 				}
 			};
+			// output history for reference and output not passed to output function yet
 			class output_type{
 			public:
-				std::deque<char> output;
+				enum{
+					CAPACITY = WINDOW_SIZE * 3,
+					COPY_BYTES = 8, // reference is copied by 8 bytes and may write over size
+				};
+				std::vector<char> window; // [0, size) is valid
+				size_t size;
+				size_t flushed;
+				uint64_t total;
 				output_type()
+					: window(CAPACITY + COPY_BYTES * 2)
+					, size(0)
+					, flushed(0)
+					, total(0)
+				{
+				}
+				size_t available() const
 				{
+					return CAPACITY - size;
 				}
 				bool write(const char * data, size_t length)
 				{
-					output.insert(output.end(), data, data + length);
+					if(available() < length){
+						return false;
+					}
+					memcpy(&window[size], data, length);
+					size += length;
+					total += length;
+					return true;
+				}
+				bool write(char c)
+				{
+					window[size++] = c;
+					++total;
 					return true;
 				}
+				static void copy_word(char * dst, const char * src)
+				{
+					uint64_t word;
+					memcpy(&word, src, sizeof(word));
+					memcpy(dst, &word, sizeof(word));
+				}
 				bool write_reference(size_t before, size_t length)
 				{
-					if(output.size() < before){
+					if(!before || size < before || available() < length){
 						return false;
 					}
-					size_t offset = output.size() - before;
-					while(length){
-						output.insert(output.end(), output[offset]);
-						--length;
-						++offset;
+					char * dst = &window[size];
+					const char * end = dst + length;
+					size += length;
+					total += length;
+					if(before == 1){
+						memset(dst, dst[-1], length);
+						return true;
+					}
+					if(before < COPY_BYTES){
+						// repeat pattern by bytes until it is at least COPY_BYTES long,
+						// then the pattern repeats in every multiple of before
+						size_t period = (COPY_BYTES + before - 1) / before * before;
+						const char * pattern_end = dst + std::min<size_t>(length, period - before);
+						for(; dst < pattern_end; ++dst){
+							*dst = *(dst - before);
+						}
+						before = period;
+					}
+					const char * src = dst - before;
+					for(; dst < end; dst += COPY_BYTES * 2, src += COPY_BYTES * 2){
+						copy_word(dst, src);
+						copy_word(dst + COPY_BYTES, src + COPY_BYTES);
+					}
+					return true;
+				}
+				// pass output to output function and drop history out of window
+				bool flush(const output_function& output)
+				{
+					if(flushed < size){
+						if(!output(&window[flushed], size - flushed)){
+							return false;
+						}
+						flushed = size;
+					}
+					if(WINDOW_SIZE * 2 < size){
+						size_t count = size - WINDOW_SIZE;
+						memmove(&window[0], &window[count], WINDOW_SIZE);
+						size -= count;
+						flushed -= count;
 					}
 					return true;
 				}
 			};
-			static bool decode(std::vector<char>& output, const std::vector<char>& input)
-			{
-				input_type in(input.data(), input.data() + input.size());
-				output_type out;
-				huffman_codes fixed_literal_length_hc(MAX_LITERAL_CODE);
-				huffman_codes dynamic_literal_length_hc(MAX_LITERAL_CODE);
-				huffman_codes fixed_distance_hc(MAX_DISTANCE_CODE);
-				huffman_codes dynamic_distance_hc(MAX_DISTANCE_CODE);
-				if(!fixed_literal_length_hc.setup_fixed_literal_length_table()){
+			enum state_type{
+				STATE_HEADER, // BFINAL, BTYPE
+				STATE_STORED_HEADER, // LEN, NLEN
+				STATE_STORED,
+				STATE_DYNAMIC_HEADER, // HLIT, HDIST, HCLEN
+				STATE_CODE_LENGTH_CODES,
+				STATE_CODE_LENGTHS,
+				STATE_DATA,
+				STATE_DONE,
+				STATE_ERROR,
+			};
+			state_type state;
+			input_type in;
+			output_type out;
+			uint64_t total_in; // bytes loaded from input
+			size_t unused; // bytes of last input after end of stream
+			const char * fragment; // input of current write
+			size_t skip_bits; // bits to skip at beginning of next input
+			block_function block_callback; // called at end of each non final block
+			uint8_t BFINAL;
+			uint16_t HLIT;
+			uint16_t HDIST;
+			uint16_t HCLEN;
+			uint16_t stored_length;
+			size_t code_length_index;
+			std::vector<size_t> code_lengths;
+			huffman_codes dynamic_literal_length_hc;
+			huffman_codes dynamic_distance_hc;
+			huffman_codes hc_len;
+			const huffman_codes * literal_length_hc;
+			const huffman_codes * distance_hc;
+			decoder()
+				: state(STATE_HEADER)
+				, total_in(0)
+				, unused(0)
+				, fragment(nullptr)
+				, skip_bits(0)
+				, BFINAL(0)
+				, HLIT(0)
+				, HDIST(0)
+				, HCLEN(0)
+				, stored_length(0)
+				, code_length_index(0)
+				, code_lengths(MAX_LITERAL_CODE + MAX_DISTANCE_CODE, 0)
+				, dynamic_literal_length_hc(MAX_LITERAL_CODE)
+				, dynamic_distance_hc(MAX_DISTANCE_CODE)
+				, hc_len(19)
+				, literal_length_hc(nullptr)
+				, distance_hc(nullptr)
+			{
+			}
+			// start a new stream, output window and tables are reused
+			void reset()
+			{
+				state = STATE_HEADER;
+				in = input_type();
+				out.size = out.flushed = 0;
+				out.total = 0;
+				total_in = 0;
+				unused = 0;
+				fragment = nullptr;
+				skip_bits = 0;
+				BFINAL = 0;
+				HLIT = HDIST = HCLEN = 0;
+				stored_length = 0;
+				code_length_index = 0;
+				literal_length_hc = nullptr;
+				distance_hc = nullptr;
+			}
+			bool done() const
+			{
+				return state == STATE_DONE;
+			}
+			// whole bytes after end of stream left in bit buffer from previous writes, they precede unused bytes of last write
+			std::vector<char> buffered() const
+			{
+				std::vector<char> bytes;
+				if(state == STATE_DONE){
+					for(size_t i = 0; i < in.bit_count / 8; ++i){
+						bytes.push_back(static_cast<char>(in.bits >> (i * 8)));
+					}
+				}
+				return bytes;
+			}
+			// use last WINDOW_SIZE bytes of data as history before first write
+			bool set_dictionary(const char * data, size_t size)
+			{
+				if(state != STATE_HEADER || total_in || out.size){
 					return false;
 				}
-				if(!fixed_distance_hc.setup_fixed_distance_table()){
+				if(WINDOW_SIZE < size){
+					data += size - WINDOW_SIZE;
+					size = WINDOW_SIZE;
+				}
+				memcpy(&out.window[0], data, size);
+				out.size = out.flushed = size;
+				return true;
+			}
+			// start at a block boundary in the middle of stream.
+			// window is the last output before the boundary, input starts from byte including bit_offset.
+			// bit_position() and out.total continue from bit_offset and output_offset.
+			bool resume(const char * window, size_t size, uint64_t bit_offset, uint64_t output_offset)
+			{
+				if(!set_dictionary(window, size)){
 					return false;
 				}
-				uint8_t BFINAL = 0;
-				do{
-					int BTYPE;
-					if(!in.read(BFINAL, 1) || !in.read(BTYPE, 2)){
-						fprintf(stderr, "read failed BFINAL, BTYPE\n");
-						return false;
+				total_in = bit_offset / 8;
+				skip_bits = bit_offset % 8;
+				out.total = output_offset;
+				return true;
+			}
+			// bit position in input stream, valid in block callback
+			uint64_t bit_position() const
+			{
+				return (total_in + (fragment ? in.begin - fragment : 0)) * 8 - in.bit_count;
+			}
+			// decode a fragment of input, output is passed to output function by at most 2 * WINDOW_SIZE bytes
+			bool write(const char * data, size_t size, const output_function& output)
+			{
+				if(state == STATE_DONE){
+					unused = size;
+					return true;
+				}
+				in.begin = data;
+				in.end = data + size;
+				fragment = data;
+				if(skip_bits && size){
+					in.refill();
+					in.advance(skip_bits);
+					skip_bits = 0;
+				}
+				bool result = inflate(output) && out.flush(output);
+				if(state == STATE_DONE){
+					// give back whole bytes in bit buffer to input
+					in.skip_to_byte_align();
+					size_t count = std::min<size_t>(in.bit_count / 8, in.begin - data);
+					in.begin -= count;
+					in.bit_count -= count * 8;
+					in.bits = in.bit_count < 64 ? in.bits & ((static_cast<uint64_t>(1) << in.bit_count) - 1) : in.bits;
+				} else{
+					// keep rest of fragment in bit buffer until next write
+					in.refill();
+				}
+				total_in += in.begin - data;
+				unused = in.end - in.begin;
+				in.begin = in.end = nullptr;
+				fragment = nullptr;
+				return result;
+			}
+			bool write(std::vector<char>& output, const char * data, size_t size)
+			{
+				return write(data, size, [&output](const char * data, size_t size){
+					output.insert(output.end(), data, data + size);
+					return true;
+				});
+			}
+			bool error(const char * message)
+			{
+				fprintf(stderr, "%s\n", message);
+				state = STATE_ERROR;
+				return false;
+			}
+			bool end_block()
+			{
+				if(BFINAL){
+					state = STATE_DONE;
+					return true;
+				}
+				state = STATE_HEADER;
+				if(block_callback && !block_callback(*this)){
+					return error("block callback error");
+				}
+				return true;
+			}
+			// decode until end of stream or end of input
+			bool inflate(const output_function& output)
+			{
+				while(true){
+					switch(state){
+					case STATE_HEADER:
+					{
+						if(in.size() < 3){
+							return true;
+						}
+						uint8_t BTYPE;
+						if(!in.read(BFINAL, 1) || !in.read(BTYPE, 2)){
+							return error("failed to read block header");
+						}
+						if(BTYPE == BTYPE_NO_COMPRESSION){
+							//skip any remaining bits in current partially processed byte
+							in.skip_to_byte_align();
+							state = STATE_STORED_HEADER;
+						} else if(BTYPE == BTYPE_FIXED_HUFFMAN_CODES){
+							literal_length_hc = &huffman_codes::fixed_literal_length();
+							distance_hc = &huffman_codes::fixed_distance();
+							state = STATE_DATA;
+						} else if(BTYPE == BTYPE_DYNAMIC_HUFFMAN_CODES){
+							state = STATE_DYNAMIC_HEADER;
+						} else{
+							return error("invalid BTYPE");
+						}
+						break;
 					}
-					if(BTYPE == BTYPE_NO_COMPRESSION){
-						//skip any remaining bits in current partially processed byte
-						in.skip_to_byte_align();
+					case STATE_STORED_HEADER:
+					{
 						//read LEN and NLEN
 						uint16_t LEN, NLEN;
+						if(in.size() < 32){
+							return true;
+						}
 						if(!in.read(LEN, 16) || !in.read(NLEN, 16)){
-							fprintf(stderr, "read failed LEN, NLEN\n");
-							return false;
+							return error("failed to read LEN, NLEN");
 						}
 						if(LEN != ((~NLEN) & 0xFFFF)){
 							fprintf(stderr, "LEN, NLEN error %04x %04x\n", LEN, NLEN);
-							return false;
+							return error("invalid stored block");
 						}
+						stored_length = LEN;
+						state = STATE_STORED;
+						break;
+					}
+					case STATE_STORED:
 						//copy LEN bytes of data to output
-						if(!out.write(in.begin, LEN)){
-							return false;
-						}
-						in.advance(LEN);
-					} else{
-						huffman_codes & literal_length_hc = (BTYPE == BTYPE_DYNAMIC_HUFFMAN_CODES ? dynamic_literal_length_hc : fixed_literal_length_hc);
-						huffman_codes & distance_hc = (BTYPE == BTYPE_DYNAMIC_HUFFMAN_CODES ? dynamic_distance_hc : fixed_distance_hc);
-						if(BTYPE == BTYPE_DYNAMIC_HUFFMAN_CODES){
-							//read representation of code trees
-							//literal/length codes
-							//distance codes
-							uint16_t HLIT;
-							uint16_t HDIST;
-							uint16_t HCLEN;
-							if(!in.read(HLIT, 5) || !in.read(HDIST, 5) || !in.read(HCLEN, 4)){
-								fprintf(stderr, "read HLIT, HDIST, HCLEN error %04x %04x\n", HLIT, HDIST, HCLEN);
-								return false;
-							}
-							HLIT += 257;
-							HDIST += 1;
-							HCLEN += 4;
-							if(MAX_LITERAL_CODE < HLIT || MAX_DISTANCE_CODE < HDIST || 19 < HCLEN){
-								fprintf(stderr, "invalid HLIT, HDIST, HCLEN error %04x %04x\n", HLIT, HDIST, HCLEN);
-								return false;
-							}
-							huffman_codes hc_len(19);
-							static const size_t hc_index[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-							for(uint16_t i = 0; i < HCLEN; ++i){
-								auto& code = hc_len.codes[hc_index[i]];
-								auto& length = code.length;
-								if(!in.read(length, 3)){
-									fprintf(stderr, "read error HC\n");
-									return false;
+						while(stored_length){
+							if(!out.available() && !out.flush(output)){
+								return error("output error");
+							}
+							if(in.bit_count){
+								char c;
+								if(!in.read(c, 8)){
+									return error("failed to read stored data");
 								}
+								out.write(c);
+								--stored_length;
+								continue;
 							}
-							if(!hc_len.setup_tree()){
-								fprintf(stderr, "failed to hc_len setup\n");
-								return false;
+							// bits beyond bit_count may hold bytes after begin
+							in.bits = 0;
+							size_t count = std::min<size_t>(std::min<size_t>(stored_length, in.end - in.begin), out.available());
+							if(!count){
+								return true;
 							}
-							size_t literal_distance_lengths[MAX_LITERAL_CODE + MAX_DISTANCE_CODE] = {};
-							for(size_t i = 0; i < HLIT + HDIST; ){
-								auto& length = literal_distance_lengths[i];
-								if(!in.read_literal(length, hc_len)){
-									fprintf(stderr, "failed to read literal for HLIT, HDIST\n");
-									return false;
-								}
-								if(length < 16){
-									++i;
-								} else if(length == 16){
-									if(i == 0){
-										fprintf(stderr, "invalid reference for HLIT/HDIST\n");
-										return false;
-									}
-									size_t src = literal_distance_lengths[i - 1];
-									size_t count;
-									if(!in.read(count, 2)){
-										return false;
-									}
-									count += 3;
-									for(size_t end = i + count; i < end && i < HLIT + HDIST; ++i){
-										literal_distance_lengths[i] = src;
-									}
-								} else if(length == 17 || length == 18){
-									size_t count;
-									if(!in.read(count, length == 17 ? 3 : 7)){
-										return false;
-									}
-									count += (length == 17 ? 3 : 11);
-									for(size_t end = i + count; i < end && i < HLIT + HDIST; ++i){
-										literal_distance_lengths[i] = 0;
-									}
-								} else{
-									fprintf(stderr, "invalid hc_len %zd\n", length);
-									return false;
-								}
+							out.write(in.begin, count);
+							in.begin += count;
+							stored_length -= static_cast<uint16_t>(count);
+						}
+						if(!end_block()){
+							return false;
+						}
+						break;
+					case STATE_DYNAMIC_HEADER:
+						//read representation of code trees
+						if(in.size() < 14){
+							return true;
+						}
+						if(!in.read(HLIT, 5) || !in.read(HDIST, 5) || !in.read(HCLEN, 4)){
+							return error("failed to read HLIT, HDIST, HCLEN");
+						}
+						HLIT += 257;
+						HDIST += 1;
+						HCLEN += 4;
+						// literal/length codes 286, 287 and distance codes 30, 31 do not occur in data
+						if(MAX_LITERAL_CODE - 2 < HLIT || MAX_DISTANCE_CODE - 2 < HDIST || 19 < HCLEN){
+							fprintf(stderr, "invalid HLIT, HDIST, HCLEN error %04x %04x %04x\n", HLIT, HDIST, HCLEN);
+							return error("invalid dynamic block header");
+						}
+						hc_len.clear();
+						code_length_index = 0;
+						state = STATE_CODE_LENGTH_CODES;
+						break;
+					case STATE_CODE_LENGTH_CODES:
+					{
+						const size_t * hc_index = code_length_order();
+						while(code_length_index < HCLEN){
+							if(in.size() < 3){
+								return true;
 							}
-							dynamic_literal_length_hc.clear();
-							dynamic_distance_hc.clear();
-							for(uint16_t i = 0; i < HLIT; ++i){
-								dynamic_literal_length_hc.codes[i].length = literal_distance_lengths[i];
+							if(!in.read(hc_len.codes[hc_index[code_length_index++]].length, 3)){
+								return error("failed to read code length code lengths");
 							}
-							for(uint16_t i = HLIT; i < MAX_LITERAL_CODE; ++i){
-								dynamic_literal_length_hc.codes[i].length = 0;
+						}
+						if(!hc_len.setup_tree()){
+							return error("failed to hc_len setup");
+						}
+						std::fill(code_lengths.begin(), code_lengths.end(), 0);
+						code_length_index = 0;
+						state = STATE_CODE_LENGTHS;
+						break;
+					}
+					case STATE_CODE_LENGTHS:
+						while(code_length_index < static_cast<size_t>(HLIT + HDIST)){
+							const input_type saved(in);
+							size_t length;
+							if(!in.read_literal(length, hc_len)){
+								if(in.bit_count < hc_len.max_length){
+									return true;
+								}
+								return error("failed to read literal for HLIT, HDIST");
 							}
-							if(!dynamic_literal_length_hc.setup_tree()){
-								fprintf(stderr, "failed to dynamic_literal_length_hc setup\n");
-								return false;
+							if(length < 16){
+								code_lengths[code_length_index++] = length;
+								continue;
 							}
-							for(uint16_t i = 0; i < HDIST; ++i){
-								dynamic_distance_hc.codes[i].length = literal_distance_lengths[HLIT + i];
+							size_t src = 0;
+							size_t count;
+							if(length == 16){
+								if(code_length_index == 0){
+									return error("invalid reference for HLIT/HDIST");
+								}
+								src = code_lengths[code_length_index - 1];
+								if(!in.read(count, 2)){
+									in = saved;
+									return true;
+								}
+								count += 3;
+							} else if(length == 17 || length == 18){
+								if(!in.read(count, length == 17 ? 3 : 7)){
+									in = saved;
+									return true;
+								}
+								count += (length == 17 ? 3 : 11);
+							} else{
+								return error("invalid hc_len");
 							}
-							for(uint16_t i = HDIST; i < MAX_DISTANCE_CODE; ++i){
-								dynamic_distance_hc.codes[i].length = 0;
+							if(static_cast<size_t>(HLIT + HDIST) - code_length_index < count){
+								return error("invalid bit length repeat");
 							}
-							if(!dynamic_distance_hc.setup_tree()){
-								fprintf(stderr, "failed to dynamic_distance_hc setup\n");
-								return false;
+							for(size_t end = code_length_index + count; code_length_index < end; ++code_length_index){
+								code_lengths[code_length_index] = src;
 							}
-						} else if(BTYPE != BTYPE_FIXED_HUFFMAN_CODES){
-							fprintf(stderr, "invalid BTYPE %d\n", BTYPE);
-							return false;
 						}
+						dynamic_literal_length_hc.clear();
+						dynamic_distance_hc.clear();
+						for(uint16_t i = 0; i < HLIT; ++i){
+							dynamic_literal_length_hc.codes[i].length = code_lengths[i];
+						}
+						if(!dynamic_literal_length_hc.setup_tree()){
+							return error("failed to dynamic_literal_length_hc setup");
+						}
+						for(uint16_t i = 0; i < HDIST; ++i){
+							dynamic_distance_hc.codes[i].length = code_lengths[HLIT + i];
+						}
+						if(!dynamic_distance_hc.setup_tree()){
+							return error("failed to dynamic_distance_hc setup");
+						}
+						literal_length_hc = &dynamic_literal_length_hc;
+						distance_hc = &dynamic_distance_hc;
+						state = STATE_DATA;
+						break;
+					case STATE_DATA:
 						while(true){
+							if(out.available() < MAX_LENGTH && !out.flush(output)){
+								return error("output error");
+							}
+							const input_type saved(in);
 							//decode literal/length value from input stream
 							literal_type value;
-							if(!in.read_literal(value, literal_length_hc)){
-								fprintf(stderr, "failed to read literal \n");
-								return false;
+							if(!in.read_literal(value, *literal_length_hc)){
+								if(in.bit_count < literal_length_hc->max_length){
+									return true;
+								}
+								return error("failed to read literal");
 							}
 							if(value < END_OF_BLOCK){
 								//copy value (literal byte) to output stream
-								char c = value;
-								if(!out.write(&c, 1)){
-									fprintf(stderr, "output error\n");
+								out.write(static_cast<char>(value));
+								continue;
+							}
+							if(value == END_OF_BLOCK){
+								if(!end_block()){
 									return false;
 								}
-							} else if(value == END_OF_BLOCK){
 								break;
-							} else if(END_OF_BLOCK < value && value <= 285){//257..285
-								static const size_t length_extra_bits_table[29] = {
-									0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
-									1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
-									4, 4, 4, 4, 5, 5, 5, 5, 0
-								};
-								static const uint16_t length_base_table[29] = {
-									3, 4, 5, 6, 7, 8, 9, 10, 11, 13,
-									15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
-									67, 83, 99, 115, 131, 163, 195, 227, 258
-								};
-								uint16_t length = 0;
-								size_t length_extra_bits = length_extra_bits_table[value - 257];
-								if(!in.read(length, length_extra_bits)){
-									fprintf(stderr, "failed to read length extra bits %zd\n", length_extra_bits);
-									return false;
-								}
-								length += length_base_table[value - 257];
-								//decode distance from input stream
-								literal_type distance_value;
-								if(!in.read_literal(distance_value, distance_hc)){
-									return false;
-								}
-								if(30 <= distance_value){
-									fprintf(stderr, "distance is invalid %d\n", distance_value);
-									return false;
-								}
-								static const uint16_t distance_base_table[30] = {
-									1, 2, 3, 4, 5, 7, 9, 13, 17, 25,
-									33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
-									1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
-								};
-								uint16_t distance = 0;
-								size_t distance_extra_bits = distance_value < 4 ? 0 : (distance_value / 2 - 1);
-								if(!in.read(distance, distance_extra_bits)){
-									fprintf(stderr, "failed to read distance extra bits %zd\n", distance_extra_bits);
-									return false;
-								}
-								distance += distance_base_table[distance_value];
-								//move backwards distance bytes in the output stream, 
-								// and copy length bytes from this position to the output stream.
-								if(!out.write_reference(distance, length)){
-									fprintf(stderr, "reference copy failed currentsize=%zd, distance=%zd lenght=%zd\n", out.output.size(), distance, length);
-									return false;
+							}
+							if(285 < value){
+								return error("invalid literal/length");
+							}
+							uint16_t length = 0;
+							size_t length_extra_bits = deflate::length_extra_bits()[value - 257];
+							if(!in.read(length, length_extra_bits)){
+								in = saved;
+								return true;
+							}
+							length += length_base()[value - 257];
+							//decode distance from input stream
+							literal_type distance_value;
+							if(!in.read_literal(distance_value, *distance_hc)){
+								if(in.bit_count < distance_hc->max_length){
+									in = saved;
+									return true;
 								}
+								return error("failed to read distance");
+							}
+							if(30 <= distance_value){
+								fprintf(stderr, "distance is invalid %d\n", distance_value);
+								return error("invalid distance");
+							}
+							uint16_t distance = 0;
+							size_t distance_extra_bits = deflate::distance_extra_bits()[distance_value];
+							if(!in.read(distance, distance_extra_bits)){
+								in = saved;
+								return true;
+							}
+							distance += distance_base()[distance_value];
+							//move backwards distance bytes in the output stream,
+							// and copy length bytes from this position to the output stream.
+							if(!out.write_reference(distance, length)){
+								fprintf(stderr, "reference copy failed currentsize=%zd, distance=%d lenght=%d\n", out.size, distance, length);
+								return error("invalid reference");
 							}
 						}
+						break;
+					case STATE_DONE:
+						return true;
+					case STATE_ERROR:
+					default:
+						return false;
 					}
-				} while(!BFINAL);
-				output.assign(out.output.begin(), out.output.end());
+				}
+			}
+			static bool decode(std::vector<char>& output, const std::vector<char>& input, const std::vector<char>& dictionary = std::vector<char>())
+			{
+				decoder d;
+				output.clear();
+				if(!dictionary.empty() && !d.set_dictionary(dictionary.data(), dictionary.size())){
+					return false;
+				}
+				if(!d.write(output, input.data(), input.size())){
+					return false;
+				}
+				if(!d.done()){
+					fprintf(stderr, "unexpected end of deflate stream\n");
+					return false;
+				}
 				return true;
 			}
 		};
-		static bool encode(std::vector<char>& output, const std::vector<char>& input)
+		// dictionary is preset history of up to WINDOW_SIZE bytes, same dictionary is required to decode
+		static bool encode(std::vector<char>& output, const std::vector<char>& input, int level = DEFAULT_LEVEL, const std::vector<char>& dictionary = std::vector<char>())
 		{
-			return encoder::encode(output, input);
+			return encoder::encode(output, input, encoder::parameters::level(level), dictionary);
 		}
-		static bool decode(std::vector<char>& output, const std::vector<char>& input)
+		static bool decode(std::vector<char>& output, const std::vector<char>& input, const std::vector<char>& dictionary = std::vector<char>())
 		{
-			return decoder::decode(output, input);
+			return decoder::decode(output, input, dictionary);
 		}
 	};
 }
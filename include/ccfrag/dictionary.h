@@ -0,0 +1,147 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <ccfrag/deflate.h>
+
+namespace ccfrag{
+	// preset dictionary for deflate from frequent substrings of sample documents.
+	// input is split into epochs and the segment covering most frequent k-mers is selected from each epoch,
+	// as COVER algorithm of zstd dictionary builder.
+	class dictionary{
+	public:
+		class parameters{
+		public:
+			size_t size; // maximum size of dictionary
+			size_t kmer_length; // length of substrings to count
+			size_t segment_length; // length of substrings in dictionary
+			parameters(size_t size = deflate::WINDOW_SIZE, size_t kmer_length = 8, size_t segment_length = 256)
+				: size(std::min<size_t>(size, deflate::WINDOW_SIZE))
+				, kmer_length(std::max<size_t>(kmer_length, deflate::MIN_LENGTH))
+				, segment_length(std::max(segment_length, this->kmer_length))
+			{
+			}
+		};
+		// FNV-1a
+		static uint64_t hash(const char * data, size_t length)
+		{
+			uint64_t value = 14695981039346656037ULL;
+			for(size_t i = 0; i < length; ++i){
+				value = (value ^ static_cast<uint8_t>(data[i])) * 1099511628211ULL;
+			}
+			return value;
+		}
+		class segment_type{
+		public:
+			size_t position;
+			uint64_t score;
+			segment_type(size_t position, uint64_t score)
+				: position(position)
+				, score(score)
+			{
+			}
+		};
+		// best segment in [begin, end) positions of k-mers, positions without k-mer are marked by valid
+		static bool find_segment(size_t& best_position, uint64_t& best_score, size_t begin, size_t end,
+			const std::vector<uint64_t>& kmers, const std::vector<char>& valid,
+			const std::unordered_map<uint64_t, uint32_t>& frequencies, size_t window)
+		{
+			std::unordered_map<uint64_t, uint32_t> active; // count of k-mers in window
+			uint64_t score = 0; // sum of frequencies of distinct k-mers in window
+			best_score = 0;
+			size_t start = begin;
+			for(size_t p = begin; p < end; ++p){
+				if(!valid[p]){
+					active.clear();
+					score = 0;
+					start = p + 1;
+					continue;
+				}
+				if(!active[kmers[p]]++){
+					score += frequencies.find(kmers[p])->second;
+				}
+				if(p + 1 - start < window){
+					continue;
+				}
+				if(best_score < score){
+					best_score = score;
+					best_position = start;
+				}
+				auto it = active.find(kmers[start]);
+				if(!--it->second){
+					score -= frequencies.find(kmers[start])->second;
+					active.erase(it);
+				}
+				++start;
+			}
+			return best_score != 0;
+		}
+		static bool train(std::vector<char>& output, const std::vector<std::vector<char>>& samples, const parameters& params = parameters())
+		{
+			output.clear();
+			const size_t k = params.kmer_length;
+			std::vector<char> data;
+			for(auto& sample : samples){
+				data.insert(data.end(), sample.begin(), sample.end());
+			}
+			// k-mer at each position which does not cross end of sample
+			std::vector<uint64_t> kmers(data.size(), 0);
+			std::vector<char> valid(data.size(), 0);
+			// number of samples containing k-mer, k-mers in only one sample are not worth sharing
+			std::unordered_map<uint64_t, uint32_t> frequencies;
+			size_t offset = 0;
+			for(auto& sample : samples){
+				std::vector<uint64_t> distinct;
+				for(size_t i = 0; i + k <= sample.size(); ++i){
+					kmers[offset + i] = hash(sample.data() + i, k);
+					valid[offset + i] = 1;
+					distinct.push_back(kmers[offset + i]);
+				}
+				std::sort(distinct.begin(), distinct.end());
+				distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+				for(auto h : distinct){
+					++frequencies[h];
+				}
+				offset += sample.size();
+			}
+			for(auto& f : frequencies){
+				if(f.second < 2){
+					f.second = 0;
+				}
+			}
+			const size_t window = params.segment_length - k + 1;
+			const size_t epochs = std::max<size_t>(1, std::min(params.size, data.size()) / params.segment_length);
+			const size_t epoch_size = data.size() / epochs;
+			std::vector<segment_type> segments;
+			size_t total = 0;
+			for(size_t epoch = 0; epoch < epochs && total < params.size; ++epoch){
+				size_t position;
+				uint64_t score;
+				size_t end = epoch + 1 == epochs ? data.size() : (epoch + 1) * epoch_size;
+				if(!find_segment(position, score, epoch * epoch_size, end, kmers, valid, frequencies, window)){
+					continue;
+				}
+				// covered k-mers do not score again
+				for(size_t p = position; p < position + window; ++p){
+					frequencies[kmers[p]] = 0;
+				}
+				segments.push_back(segment_type(position, score));
+				total += params.segment_length;
+			}
+			if(segments.empty()){
+				return false;
+			}
+			// most valuable segments at end, nearest to data to reduce distance
+			std::stable_sort(segments.begin(), segments.end(), [](const segment_type& lhs, const segment_type& rhs){
+				return lhs.score < rhs.score;
+			});
+			for(auto& segment : segments){
+				output.insert(output.end(), data.begin() + segment.position, data.begin() + segment.position + params.segment_length);
+			}
+			if(params.size < output.size()){
+				output.erase(output.begin(), output.end() - params.size);
+			}
+			return true;
+		}
+	};
+}
@@ -4,7 +4,18 @@
 #include <vector>
 #include <deque>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <new>
 #include <ccfrag/deflate.h>
+#include <ccfrag/cpu.h>
+#if defined(CCFRAG_X86_64)
+#define CCFRAG_CRC32_PCLMUL
+#elif defined(CCFRAG_AARCH64) && (defined(__ARM_FEATURE_CRC32) || (defined(__GNUC__) && !defined(__clang__)))
+// gcc declares crc32 intrinsics for functions with target("+crc"), so the kernel is selected at runtime
+#define CCFRAG_CRC32_ARM
+#include <arm_acle.h>
+#endif
 
 namespace ccfrag{
 	// https://tools.ietf.org/html/rfc1952
@@ -16,22 +27,22 @@ namespace ccfrag{
 			static const uint32_t * crc_table()
 			{
 				static const uint32_t table[256] = {
-					0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
-					0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7, 0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
-					0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-					0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
-					0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433, 0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
-					0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-					0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
-					0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f, 0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
-					0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-					0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
-					0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b, 0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
-					0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-					0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
-					0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777, 0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
-					0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-					0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+					0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+					0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7, 0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+					0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+					0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+					0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433, 0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+					0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+					0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+					0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f, 0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+					0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+					0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+					0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b, 0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+					0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+					0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+					0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777, 0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+					0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+					0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 				};
 #if 0
 				for(uint32_t n = 0; n < 256; ++n){
@@ -61,16 +72,238 @@ namespace ccfrag{
 				c ^= 0xFFFFFFFFUL;
 				return c;
 			}
+			// contiguous data is processed by the fastest kernel on this cpu
+			static uint32_t execute(const char * begin, const char * end, uint32_t c = 0)
+			{
+				return ~kernel()(reinterpret_cast<const uint8_t *>(begin), end - begin, ~c);
+			}
+			static uint32_t execute(char * begin, char * end, uint32_t c = 0)
+			{
+				return execute(const_cast<const char *>(begin), const_cast<const char *>(end), c);
+			}
+			// kernels update crc register (not inverted crc) by size bytes of data
+			typedef uint32_t (*kernel_type)(const uint8_t * data, size_t size, uint32_t c);
+			static uint32_t execute_bytes(const uint8_t * data, size_t size, uint32_t c)
+			{
+				const uint32_t * table = crc_table();
+				for(const uint8_t * end = data + size; data != end; ++data){
+					c = table[(c ^ *data) & 0xFF] ^ (c >> 8);
+				}
+				return c;
+			}
+			// table[n][b] is crc of byte b followed by n zero bytes
+			static const uint32_t (*slice_table())[256]
+			{
+				struct tables_type{
+					uint32_t table[16][256];
+					tables_type()
+					{
+						const uint32_t * base = crc_table();
+						std::copy(base, base + 256, table[0]);
+						for(size_t n = 1; n < 16; ++n){
+							for(size_t b = 0; b < 256; ++b){
+								uint32_t c = table[n - 1][b];
+								table[n][b] = base[c & 0xFF] ^ (c >> 8);
+							}
+						}
+					}
+				};
+				static const tables_type tables;
+				return tables.table;
+			}
+			static uint32_t execute_slice8(const uint8_t * data, size_t size, uint32_t c)
+			{
+				const uint32_t (*table)[256] = slice_table();
+				for(; 8 <= size; data += 8, size -= 8){
+					uint64_t word = bitstream::load_word(reinterpret_cast<const char *>(data)) ^ c;
+					c = table[7][word & 0xFF] ^ table[6][(word >> 8) & 0xFF] ^
+						table[5][(word >> 16) & 0xFF] ^ table[4][(word >> 24) & 0xFF] ^
+						table[3][(word >> 32) & 0xFF] ^ table[2][(word >> 40) & 0xFF] ^
+						table[1][(word >> 48) & 0xFF] ^ table[0][word >> 56];
+				}
+				return execute_bytes(data, size, c);
+			}
+			static uint32_t execute_slice16(const uint8_t * data, size_t size, uint32_t c)
+			{
+				const uint32_t (*table)[256] = slice_table();
+				for(; 16 <= size; data += 16, size -= 16){
+					uint64_t word0 = bitstream::load_word(reinterpret_cast<const char *>(data)) ^ c;
+					uint64_t word1 = bitstream::load_word(reinterpret_cast<const char *>(data + 8));
+					c = table[15][word0 & 0xFF] ^ table[14][(word0 >> 8) & 0xFF] ^
+						table[13][(word0 >> 16) & 0xFF] ^ table[12][(word0 >> 24) & 0xFF] ^
+						table[11][(word0 >> 32) & 0xFF] ^ table[10][(word0 >> 40) & 0xFF] ^
+						table[9][(word0 >> 48) & 0xFF] ^ table[8][word0 >> 56] ^
+						table[7][word1 & 0xFF] ^ table[6][(word1 >> 8) & 0xFF] ^
+						table[5][(word1 >> 16) & 0xFF] ^ table[4][(word1 >> 24) & 0xFF] ^
+						table[3][(word1 >> 32) & 0xFF] ^ table[2][(word1 >> 40) & 0xFF] ^
+						table[1][(word1 >> 48) & 0xFF] ^ table[0][word1 >> 56];
+				}
+				return execute_slice8(data, size, c);
+			}
+#ifdef CCFRAG_CRC32_PCLMUL
+			// fold 4 x 128 bits by carry-less multiplication, then reduce by barrett reduction.
+			// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel
+			CCFRAG_TARGET("sse2,pclmul")
+			static uint32_t execute_pclmul(const uint8_t * data, size_t size, uint32_t c)
+			{
+				if(size < 64){
+					return execute_slice16(data, size, c);
+				}
+				alignas(16) static const uint64_t k1k2[2] = {0x0154442bd4ULL, 0x01c6e41596ULL};
+				alignas(16) static const uint64_t k3k4[2] = {0x01751997d0ULL, 0x00ccaa009eULL};
+				alignas(16) static const uint64_t k5k0[2] = {0x0163cd6124ULL, 0x0000000000ULL};
+				alignas(16) static const uint64_t poly[2] = {0x01db710641ULL, 0x01f7011641ULL};
+				__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+				x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+				x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+				x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+				x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+				x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(c)));
+				x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+				data += 64;
+				size -= 64;
+				// fold 512 bits
+				for(; 64 <= size; data += 64, size -= 64){
+					x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+					x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+					x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+					x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+					x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+					x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+					x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+					x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+					x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00)));
+					x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10)));
+					x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20)));
+					x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30)));
+				}
+				// fold into 128 bits
+				x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+				x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+				x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+				x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+				// fold remaining 128 bit blocks
+				for(; 16 <= size; data += 16, size -= 16){
+					x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+					x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+					x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+					x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+				}
+				// fold 128 bits to 64 bits
+				x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+				x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+				x1 = _mm_srli_si128(x1, 8);
+				x1 = _mm_xor_si128(x1, x2);
+				x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+				x2 = _mm_srli_si128(x1, 4);
+				x1 = _mm_and_si128(x1, x3);
+				x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+				x1 = _mm_xor_si128(x1, x2);
+				// barrett reduction to 32 bits
+				x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+				x2 = _mm_and_si128(x1, x3);
+				x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+				x2 = _mm_and_si128(x2, x3);
+				x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+				x1 = _mm_xor_si128(x1, x2);
+				c = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+				return execute_slice16(data, size, c);
+			}
+#endif
+#ifdef CCFRAG_CRC32_ARM
+			CCFRAG_TARGET("+crc")
+			static uint32_t execute_arm(const uint8_t * data, size_t size, uint32_t c)
+			{
+				for(; 8 <= size; data += 8, size -= 8){
+					c = __crc32d(c, bitstream::load_word(reinterpret_cast<const char *>(data)));
+				}
+				for(; size; ++data, --size){
+					c = __crc32b(c, *data);
+				}
+				return c;
+			}
+#endif
+			static kernel_type select_kernel()
+			{
+#ifdef CCFRAG_CRC32_ARM
+				if(cpu::has_crc32()){
+					return execute_arm;
+				}
+#endif
+#ifdef CCFRAG_CRC32_PCLMUL
+				if(cpu::has_pclmul()){
+					return execute_pclmul;
+				}
+#endif
+				return execute_slice16;
+			}
+			static kernel_type kernel()
+			{
+				static const kernel_type selected = select_kernel();
+				return selected;
+			}
+			static uint32_t gf2_matrix_times(const uint32_t * matrix, uint32_t vector)
+			{
+				uint32_t sum = 0;
+				for(; vector; vector >>= 1, ++matrix){
+					if(vector & 1){
+						sum ^= *matrix;
+					}
+				}
+				return sum;
+			}
+			static void gf2_matrix_square(uint32_t * square, const uint32_t * matrix)
+			{
+				for(size_t n = 0; n < 32; ++n){
+					square[n] = gf2_matrix_times(matrix, matrix[n]);
+				}
+			}
+			// crc of concatenated data from crc1 of first data and crc2 of second data of size2 bytes
+			static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t size2)
+			{
+				if(!size2){
+					return crc1;
+				}
+				uint32_t even[32]; // operator for 2^n zero bits
+				uint32_t odd[32]; // operator for 2^(n+1) zero bits
+				odd[0] = 0xedb88320UL;
+				for(size_t n = 1; n < 32; ++n){
+					odd[n] = 1UL << (n - 1);
+				}
+				gf2_matrix_square(even, odd); // 2 zero bits
+				gf2_matrix_square(odd, even); // 4 zero bits
+				// apply size2 zero bytes to crc1
+				while(true){
+					gf2_matrix_square(even, odd);
+					if(size2 & 1){
+						crc1 = gf2_matrix_times(even, crc1);
+					}
+					size2 >>= 1;
+					if(!size2){
+						break;
+					}
+					gf2_matrix_square(odd, even);
+					if(size2 & 1){
+						crc1 = gf2_matrix_times(odd, crc1);
+					}
+					size2 >>= 1;
+					if(!size2){
+						break;
+					}
+				}
+				return crc1 ^ crc2;
+			}
 		};
 		class input_type{
 		public:
 			const char * begin;
 			const char * end;
-			input_type(const input_type& rhs)
-				: begin(rhs.begin)
-				, end(rhs.end)
-			{
-			}
 			input_type(const char* begin, const char* end)
 				: begin(begin)
 				, end(end)
@@ -150,8 +383,81 @@ namespace ccfrag{
 			FLG_RESERVED = 0xE0,
 			XFL_SLOW = 2,
 			XFL_FAST = 4,
+			OS_UNKNOWN = 255,
+			PARALLEL_BLOCK_SIZE = 128 * 1024,
+			// blocked gzip (BGZF): members of at most 64KiB with compressed size in 'BC' extra subfield
+			BLOCKED_INPUT_SIZE = 0xFF00, // stored block of this size fits in a member
+			BLOCKED_MEMBER_SIZE = 0x10000,
+			BLOCKED_SI1 = 'B',
+			BLOCKED_SI2 = 'C',
+			BLOCKED_HEADER_SIZE = 18, // with XLEN 6 and BC subfield
+			TRAILER_SIZE = 8,
 		};
-		static bool encode(std::vector<char>& output, const std::vector<char>& input)
+		// run worker on threads, workers take tasks by a shared counter
+		static void run_workers(size_t threads, const std::function<void()>& worker)
+		{
+			std::vector<std::thread> workers;
+			for(size_t i = 1; i < threads; ++i){
+				workers.emplace_back(worker);
+			}
+			worker();
+			for(auto& t : workers){
+				t.join();
+			}
+		}
+		// deflate data by a block and update crc of the block while it is in cache, output is appended
+		static bool write_deflate(deflate::encoder& e, std::vector<char>& output, uint32_t& crc, const char * data, size_t size, deflate::encoder::flush_type flush)
+		{
+			do{
+				const size_t count = std::min<size_t>(size, deflate::MAX_BLOCK_SIZE);
+				crc = crc32::execute(data, data + count, crc);
+				if(!e.write(output, data, count, count == size ? flush : deflate::encoder::NO_FLUSH)){
+					return false;
+				}
+				data += count;
+				size -= count;
+			} while(size);
+			return true;
+		}
+		// deflate blocks of input on threads, each block is primed with preceding 32KiB as dictionary
+		// and ended with sync flush, so that joined blocks is a single deflate stream.
+		static bool parallel_encode(std::vector<char>& output, uint32_t& CRC32, const std::vector<char>& input, int level, size_t threads)
+		{
+			const size_t count = std::max<size_t>(1, (input.size() + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE);
+			std::vector<std::vector<char>> encoded(count);
+			std::vector<uint32_t> crcs(count);
+			std::vector<char> results(count, 0);
+			std::atomic<size_t> next(0);
+			const deflate::encoder::parameters params = deflate::encoder::parameters::level(level);
+			auto worker = [&](){
+				for(size_t index; (index = next++) < count;){
+					const char * begin = input.data() + index * PARALLEL_BLOCK_SIZE;
+					const char * end = input.data() + std::min(input.size(), (index + 1) * PARALLEL_BLOCK_SIZE);
+					const bool last = index + 1 == count;
+					deflate::encoder e(params);
+					if(index){
+						e.set_dictionary(input.data(), begin - input.data());
+					}
+					crcs[index] = 0;
+					results[index] = write_deflate(e, encoded[index], crcs[index], begin, end - begin, last ? deflate::encoder::FINISH : deflate::encoder::SYNC_FLUSH);
+				}
+			};
+			run_workers(std::min(threads, count), worker);
+			output.clear();
+			CRC32 = 0;
+			for(size_t index = 0; index < count; ++index){
+				if(!results[index]){
+					return false;
+				}
+				output.insert(output.end(), encoded[index].begin(), encoded[index].end());
+				std::vector<char>().swap(encoded[index]);
+				size_t size = std::min(input.size(), (index + 1) * PARALLEL_BLOCK_SIZE) - index * PARALLEL_BLOCK_SIZE;
+				CRC32 = crc32::combine(CRC32, crcs[index], size);
+			}
+			return true;
+		}
+		// threads > 1 for parallel compression
+		static bool encode(std::vector<char>& output, const std::vector<char>& input, int level = deflate::DEFAULT_LEVEL, size_t threads = 1)
 		{
 			output_type out;
 			uint8_t ID1 = 0x1F;
@@ -159,7 +465,7 @@ namespace ccfrag{
 			uint8_t CM = CM_DEFLATE;
 			uint8_t FLG = 0;
 			uint32_t MTIME = 0; // Modification TIME
-			uint8_t XFL = 0; // eXtra FLags
+			uint8_t XFL = (level <= deflate::MIN_LEVEL ? XFL_FAST : deflate::MAX_LEVEL <= level ? XFL_SLOW : 0); // eXtra FLags
 			uint8_t OS = 0;
 			if(!out.write(ID1) ||
 				!out.write(ID2) || 
@@ -170,14 +476,20 @@ namespace ccfrag{
 				!out.write(OS)){
 				return false;
 			}
-			std::vector<char> encoded_data;
-			if(!ccfrag::deflate::encode(encoded_data, input)){
-				return false;
-			}
-			output.reserve(encoded_data.size() + out.output.size() + 8);
 			output.assign(out.output.begin(), out.output.end());
-			output.insert(output.end(), encoded_data.begin(), encoded_data.end());
-			uint32_t CRC32 = crc32::execute(input.data(), input.data() + input.size());
+			uint32_t CRC32 = 0;
+			if(1 < threads){
+				std::vector<char> encoded_data;
+				if(!parallel_encode(encoded_data, CRC32, input, level, threads)){
+					return false;
+				}
+				output.insert(output.end(), encoded_data.begin(), encoded_data.end());
+			} else{
+				deflate::encoder e(deflate::encoder::parameters::level(level));
+				if(!write_deflate(e, output, CRC32, input.data(), input.size(), deflate::encoder::FINISH)){
+					return false;
+				}
+			}
 			uint32_t ISIZE = (input.size() & 0xFFFFFFFF);
 			out.output.clear();
 			if(!out.write(CRC32) ||
@@ -187,9 +499,11 @@ namespace ccfrag{
 			output.insert(output.end(), out.output.begin(), out.output.end());
 			return true;
 		}
-		static bool decode(std::vector<char>& output, const std::vector<char>& input)
+		// read member header, in is advanced to compressed data and extra is set to extra field
+		static bool read_header(input_type& in, input_type& extra)
 		{
-			input_type in(input.data(), input.data() + input.size());
+			const char * begin = in.begin;
+			extra = input_type(nullptr, nullptr);
 			uint8_t ID1;
 			if(!in.read(ID1) || ID1 != 0x1F){
 				fprintf(stderr, "ID1 error %02x\n", ID1);
@@ -227,10 +541,11 @@ namespace ccfrag{
 			}
 			if(FLG & FLG_FEXTRA){
 				uint16_t XLEN;
-				if(!in.read(XLEN)){
+				if(!in.read(XLEN) || in.size() < XLEN){
 					fprintf(stderr, "XLEN error %02x\n", XLEN);
 					return false;
 				}
+				extra = input_type(in.begin, in.begin + XLEN);
 				in.advance(XLEN);
 			}
 			if(FLG & FLG_FNAME){
@@ -250,36 +565,654 @@ namespace ccfrag{
 				if(!in.read(CRC16)){
 					return false;
 				}
-				uint32_t c = crc32::execute(input.data(), input.data() + input.size() - in.size()) & 0xFFFF;
+				uint32_t c = crc32::execute(begin, in.begin - 2) & 0xFFFF;
 				if(c != CRC16){
 					return false;
 				}
 			}
-			if(in.size() < 8){
-				fprintf(stderr, "too short size %zd\n", in.size());
+			return true;
+		}
+		static bool read_header(input_type& in)
+		{
+			input_type extra(nullptr, nullptr);
+			return read_header(in, extra);
+		}
+		// find subfield of extra field by SI1 and SI2
+		static bool find_subfield(input_type extra, char SI1, char SI2, input_type& subfield)
+		{
+			while(4 <= extra.size()){
+				char si1 = extra.begin[0];
+				char si2 = extra.begin[1];
+				extra.advance(2);
+				uint16_t LEN;
+				if(!extra.read(LEN) || extra.size() < LEN){
+					return false;
+				}
+				if(si1 == SI1 && si2 == SI2){
+					subfield = input_type(extra.begin, extra.begin + LEN);
+					return true;
+				}
+				extra.advance(LEN);
+			}
+			return false;
+		}
+		// member size from BC subfield of blocked gzip, no inflate
+		static bool read_blocked_member_size(const char * begin, const char * end, size_t& size)
+		{
+			input_type in(begin, end);
+			input_type extra(nullptr, nullptr);
+			input_type subfield(nullptr, nullptr);
+			uint16_t BSIZE;
+			if(!read_header(in, extra) || !find_subfield(extra, BLOCKED_SI1, BLOCKED_SI2, subfield) || !subfield.read(BSIZE)){
+				return false;
+			}
+			size = static_cast<size_t>(BSIZE) + 1;
+			return static_cast<size_t>(in.begin - begin) + TRAILER_SIZE <= size && size <= static_cast<size_t>(end - begin);
+		}
+		static bool is_blocked(const char * data, size_t size)
+		{
+			size_t member_size;
+			return read_blocked_member_size(data, data + size, member_size);
+		}
+		// a member of blocked gzip for at most BLOCKED_INPUT_SIZE bytes
+		static bool encode_blocked_member(std::vector<char>& output, deflate::encoder& e, const char * data, size_t size, int level)
+		{
+			output_type out;
+			uint8_t XFL = (level <= deflate::MIN_LEVEL ? XFL_FAST : deflate::MAX_LEVEL <= level ? XFL_SLOW : 0);
+			if(!out.write(static_cast<uint8_t>(0x1F)) ||
+				!out.write(static_cast<uint8_t>(0x8B)) ||
+				!out.write(static_cast<uint8_t>(CM_DEFLATE)) ||
+				!out.write(static_cast<uint8_t>(FLG_FEXTRA)) ||
+				!out.write(static_cast<uint32_t>(0)) || // MTIME
+				!out.write(XFL) ||
+				!out.write(static_cast<uint8_t>(OS_UNKNOWN)) ||
+				!out.write(static_cast<uint16_t>(6)) || // XLEN
+				!out.write(static_cast<uint8_t>(BLOCKED_SI1)) ||
+				!out.write(static_cast<uint8_t>(BLOCKED_SI2)) ||
+				!out.write(static_cast<uint16_t>(2)) || // SLEN
+				!out.write(static_cast<uint16_t>(0))){ // BSIZE, set after compression
+				return false;
+			}
+			output.assign(out.output.begin(), out.output.end());
+			e.reset();
+			uint32_t CRC32 = 0;
+			if(!write_deflate(e, output, CRC32, data, size, deflate::encoder::FINISH)){
+				return false;
+			}
+			out.output.clear();
+			if(!out.write(CRC32) || !out.write(static_cast<uint32_t>(size))){
+				return false;
+			}
+			output.insert(output.end(), out.output.begin(), out.output.end());
+			if(BLOCKED_MEMBER_SIZE < output.size()){
+				fprintf(stderr, "blocked gzip member overflow %zd\n", output.size());
+				return false;
+			}
+			uint16_t BSIZE = static_cast<uint16_t>(output.size() - 1);
+			output[BLOCKED_HEADER_SIZE - 2] = static_cast<char>(BSIZE & 0xFF);
+			output[BLOCKED_HEADER_SIZE - 1] = static_cast<char>(BSIZE >> 8);
+			return true;
+		}
+		// empty member of fixed 28 bytes at end of blocked gzip, readers may compare it byte for byte
+		static const std::vector<char>& blocked_eof()
+		{
+			static const std::vector<char> marker = {
+				'\x1f', '\x8b', '\x08', '\x04', '\x00', '\x00', '\x00', '\x00', '\x00', '\xff', '\x06', '\x00', 'B', 'C',
+				'\x02', '\x00', '\x1b', '\x00', '\x03', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00',
+			};
+			return marker;
+		}
+		// independent members of at most 64KiB and an empty member as end of file marker.
+		// standard gunzip decodes it as concatenated members.
+		static bool encode_blocked(std::vector<char>& output, const std::vector<char>& input, int level = deflate::DEFAULT_LEVEL, size_t threads = 1)
+		{
+			const size_t count = (input.size() + BLOCKED_INPUT_SIZE - 1) / BLOCKED_INPUT_SIZE;
+			std::vector<std::vector<char>> members(count);
+			std::vector<char> results(count, 0);
+			std::atomic<size_t> next(0);
+			const deflate::encoder::parameters params = deflate::encoder::parameters::level(level);
+			run_workers(std::min(threads, count), [&](){
+				deflate::encoder e(params);
+				for(size_t index; (index = next++) < count;){
+					size_t begin = std::min(input.size(), index * BLOCKED_INPUT_SIZE);
+					size_t end = std::min(input.size(), begin + BLOCKED_INPUT_SIZE);
+					results[index] = encode_blocked_member(members[index], e, input.data() + begin, end - begin, level);
+				}
+			});
+			output.clear();
+			for(size_t index = 0; index < count; ++index){
+				if(!results[index]){
+					return false;
+				}
+				output.insert(output.end(), members[index].begin(), members[index].end());
+			}
+			output.insert(output.end(), blocked_eof().begin(), blocked_eof().end());
+			return true;
+		}
+		// find members by BC subfield and inflate them on threads into place given by ISIZE
+		static bool decode_blocked(std::vector<char>& output, const std::vector<char>& input, size_t threads = 1)
+		{
+			std::vector<const char *> members;
+			std::vector<size_t> offsets(1, 0);
+			const char * end = input.data() + input.size();
+			for(const char * p = input.data(); p < end; ){
+				size_t size;
+				if(!read_blocked_member_size(p, end, size)){
+					fprintf(stderr, "blocked gzip member error at %zd\n", static_cast<size_t>(p - input.data()));
+					return false;
+				}
+				members.push_back(p);
+				p += size;
+				// member inflates to at most its own size limit, so output size is bounded by input size
+				input_type trailer(p - 4, p);
+				uint32_t ISIZE;
+				if(!trailer.read(ISIZE) || BLOCKED_MEMBER_SIZE < ISIZE){
+					fprintf(stderr, "blocked gzip member ISIZE error at %zd\n", static_cast<size_t>(members.back() - input.data()));
+					return false;
+				}
+				offsets.push_back(offsets.back() + ISIZE);
+			}
+			members.push_back(end);
+			try{
+				output.resize(offsets.back());
+			} catch(const std::bad_alloc&){
+				fprintf(stderr, "blocked gzip output of %zd bytes is not allocated\n", offsets.back());
+				return false;
+			}
+			const size_t count = members.size() - 1;
+			std::vector<char> results(count, 0);
+			std::atomic<size_t> next(0);
+			run_workers(std::min(threads, std::max<size_t>(count, 1)), [&](){
+				deflate::decoder d;
+				for(size_t index; (index = next++) < count;){
+					input_type in(members[index], members[index + 1] - TRAILER_SIZE);
+					if(!read_header(in)){
+						results[index] = 0;
+						continue;
+					}
+					char * dst = output.data() + offsets[index];
+					const size_t capacity = offsets[index + 1] - offsets[index];
+					size_t written = 0;
+					uint32_t crc = 0;
+					d.reset();
+					bool result = d.write(in.begin, in.size(), [&](const char * data, size_t size){
+						if(capacity - written < size){
+							return false;
+						}
+						crc = crc32::execute(data, data + size, crc);
+						memcpy(dst + written, data, size);
+						written += size;
+						return true;
+					});
+					// deflate data ends just before trailer
+					input_type trailer(in.end, members[index + 1]);
+					uint32_t CRC32;
+					results[index] = result && d.done() && !d.unused && written == capacity && trailer.read(CRC32) && crc == CRC32;
+				}
+			});
+			for(size_t index = 0; index < count; ++index){
+				if(!results[index]){
+					fprintf(stderr, "blocked gzip member %zd error\n", index);
+					return false;
+				}
+			}
+			return true;
+		}
+		// size of member header at beginning of data, 0 if data is not enough
+		static size_t header_size(const char * data, size_t size)
+		{
+			if(size < 10){
+				return 0;
+			}
+			const uint8_t FLG = static_cast<uint8_t>(data[3]);
+			size_t n = 10;
+			if(FLG & FLG_FEXTRA){
+				if(size < n + 2){
+					return 0;
+				}
+				n += 2 + (static_cast<uint8_t>(data[n]) | (static_cast<size_t>(static_cast<uint8_t>(data[n + 1])) << 8));
+			}
+			for(uint8_t flag : {FLG_FNAME, FLG_FCOMMENT}){
+				if(FLG & flag){
+					const char * terminator = n < size ? static_cast<const char *>(memchr(data + n, 0, size - n)) : nullptr;
+					if(!terminator){
+						return 0;
+					}
+					n = terminator - data + 1;
+				}
+			}
+			if(FLG & FLG_FHCRC){
+				n += 2;
+			}
+			return n <= size ? n : 0;
+		}
+		// streaming decoder of concatenated members.
+		// header is parsed as it arrives, data is inflated as it arrives and trailer is checked at end of each member.
+		class decoder{
+		public:
+			typedef deflate::decoder::output_function output_function;
+			enum state_type{
+				STATE_HEADER,
+				STATE_DATA,
+				STATE_TRAILER,
+				STATE_ERROR,
+			};
+			state_type state;
+			std::vector<char> buffer; // partial header or trailer
+			deflate::decoder inflater;
+			uint32_t crc;
+			size_t members; // completed members
+			decoder()
+				: state(STATE_HEADER)
+				, crc(0)
+				, members(0)
+			{
+			}
+			void reset()
+			{
+				state = STATE_HEADER;
+				buffer.clear();
+				crc = 0;
+				members = 0;
+			}
+			// end of input is acceptable
+			bool done() const
+			{
+				return state == STATE_HEADER && buffer.empty() && members;
+			}
+			bool error(const char * message)
+			{
+				fprintf(stderr, "%s\n", message);
+				state = STATE_ERROR;
 				return false;
 			}
-			size_t header = input.size() - in.size();
-			size_t footer = 8;
-			if(!ccfrag::deflate::decode(output, {in.begin, in.end - 8})){
-				fprintf(stderr, "deflate::decode error\n");
+			bool write(const char * data, size_t size, const output_function& output)
+			{
+				while(true){
+					switch(state){
+					case STATE_HEADER:
+					{
+						if(!size && buffer.empty()){
+							return true;
+						}
+						const size_t prefix = buffer.size();
+						const char * begin = data;
+						size_t length = size;
+						if(prefix){
+							buffer.insert(buffer.end(), data, data + size);
+							begin = buffer.data();
+							length = buffer.size();
+						}
+						if((1 <= length && static_cast<uint8_t>(begin[0]) != 0x1F) || (2 <= length && static_cast<uint8_t>(begin[1]) != 0x8B)){
+							return error("gzip magic error");
+						}
+						const size_t n = header_size(begin, length);
+						if(!n){
+							if(!prefix){
+								buffer.assign(data, data + size);
+							}
+							return true;
+						}
+						input_type in(begin, begin + n);
+						if(!read_header(in)){
+							return error("gzip header error");
+						}
+						// incomplete header was kept in buffer, so header ends in this write
+						data += n - prefix;
+						size -= n - prefix;
+						buffer.clear();
+						inflater.reset();
+						crc = 0;
+						state = STATE_DATA;
+						break;
+					}
+					case STATE_DATA:
+					{
+						uint32_t& c = crc;
+						if(!inflater.write(data, size, [&c, &output](const char * data, size_t size){
+							c = crc32::execute(data, data + size, c);
+							return output(data, size);
+						})){
+							return error("deflate error");
+						}
+						if(!inflater.done()){
+							return true;
+						}
+						buffer = inflater.buffered();
+						data += size - inflater.unused;
+						size = inflater.unused;
+						state = STATE_TRAILER;
+						break;
+					}
+					case STATE_TRAILER:
+					{
+						size_t count = std::min(size, TRAILER_SIZE - std::min<size_t>(buffer.size(), TRAILER_SIZE));
+						buffer.insert(buffer.end(), data, data + count);
+						data += count;
+						size -= count;
+						if(buffer.size() < TRAILER_SIZE){
+							return true;
+						}
+						input_type in(buffer.data(), buffer.data() + buffer.size());
+						uint32_t CRC32, ISIZE;
+						if(!in.read(CRC32) || !in.read(ISIZE)){
+							return error("gzip trailer error");
+						}
+						if(CRC32 != crc){
+							fprintf(stderr, "CRC32 error %08x != %08x\n", crc, CRC32);
+							return error("gzip trailer error");
+						}
+						if(ISIZE != (inflater.out.total & 0xFFFFFFFF)){
+							fprintf(stderr, "ISIZE error %08x != %08x\n", static_cast<uint32_t>(inflater.out.total), ISIZE);
+							return error("gzip trailer error");
+						}
+						++members;
+						buffer.erase(buffer.begin(), buffer.begin() + TRAILER_SIZE);
+						state = STATE_HEADER;
+						break;
+					}
+					case STATE_ERROR:
+					default:
+						return false;
+					}
+				}
+			}
+			bool write(std::vector<char>& output, const char * data, size_t size)
+			{
+				return write(data, size, [&output](const char * data, size_t size){
+					output.insert(output.end(), data, data + size);
+					return true;
+				});
+			}
+		};
+		// all members of input
+		static bool decode(std::vector<char>& output, const std::vector<char>& input)
+		{
+			decoder d;
+			output.clear();
+			if(!d.write(output, input.data(), input.size())){
 				return false;
 			}
-			in.advance(in.size() - 8);
-			uint32_t CRC32;
-			uint32_t c = crc32::execute(output.data(), output.data() + output.size());
-			if(!in.read(CRC32, 4) || c != CRC32){
-				fprintf(stderr, "data size %zd\n", output.size());
-				fprintf(stderr, "CRC32 error %08x != %08x\n", c, CRC32);
-				//return false;
-			}
-			uint32_t ISIZE;
-			uint32_t isize = (output.size() & 0xFFFFFFFF);
-			if(!in.read(ISIZE, 4) || isize != ISIZE){
-				fprintf(stderr, "ISIZE error %8x != %8x\n", isize, ISIZE);
+			if(!d.done()){
+				fprintf(stderr, "unexpected end of gzip\n");
 				return false;
 			}
 			return true;
 		}
+		// random access to a gzip file through checkpoints at deflate block boundaries and member starts.
+		// checkpoint has bit offset in gzip file, offset in uncompressed data and last 32KiB of output,
+		// so reading from an offset inflates only from the nearest checkpoint before it.
+		class index{
+		public:
+			typedef std::function<size_t(char * data, size_t size)> read_function; // read next bytes, 0 at end
+			typedef std::function<bool(uint64_t position)> seek_function;
+			enum{
+				DEFAULT_SPAN = 1024 * 1024,
+				READ_SIZE = 64 * 1024,
+				VERSION = 1,
+			};
+			class checkpoint{
+			public:
+				uint64_t bit_offset;
+				uint64_t offset;
+				std::vector<char> window;
+				checkpoint(uint64_t bit_offset, uint64_t offset)
+					: bit_offset(bit_offset)
+					, offset(offset)
+				{
+				}
+			};
+			uint64_t span; // minimum uncompressed distance between checkpoints
+			uint64_t size; // uncompressed size
+			std::vector<checkpoint> checkpoints;
+			index()
+				: span(DEFAULT_SPAN)
+				, size(0)
+			{
+			}
+			static const char * magic()
+			{
+				return "GZIX";
+			}
+			// inflate all members from read function and record checkpoints every span bytes of output.
+			// each member starts at a checkpoint with empty window, as it does not refer to previous members.
+			bool build(const read_function& read, uint64_t span = DEFAULT_SPAN)
+			{
+				this->span = span;
+				size = 0;
+				checkpoints.clear();
+				std::vector<char> pending; // read and not consumed yet
+				uint64_t position = 0; // offset of pending in gzip file
+				auto fill = [&](){
+					const size_t offset = pending.size();
+					pending.resize(offset + READ_SIZE);
+					const size_t length = read(pending.data() + offset, READ_SIZE);
+					pending.resize(offset + length);
+					return length != 0;
+				};
+				deflate::decoder d;
+				d.block_callback = [&](const deflate::decoder& current){
+					const auto& out = current.out;
+					if(out.total < checkpoints.back().offset + this->span){
+						return true;
+					}
+					checkpoint cp(current.bit_position(), out.total);
+					size_t count = std::min<size_t>(out.size, deflate::WINDOW_SIZE);
+					cp.window.assign(out.window.data() + out.size - count, out.window.data() + out.size);
+					checkpoints.push_back(std::move(cp));
+					return true;
+				};
+				while(true){
+					size_t n;
+					while(!(n = header_size(pending.data(), pending.size())) && fill()){
+					}
+					if(!n && pending.empty() && !checkpoints.empty()){
+						break;
+					}
+					input_type in(pending.data(), pending.data() + n);
+					if(!n || !read_header(in)){
+						fprintf(stderr, "gzip header is not found at %llu\n", static_cast<unsigned long long>(position));
+						return false;
+					}
+					position += n;
+					pending.erase(pending.begin(), pending.begin() + n);
+					// bit_position() and out.total of decoder are offsets in gzip file and uncompressed data
+					checkpoints.push_back(checkpoint(position * 8, size));
+					d.reset();
+					if(!d.resume(nullptr, 0, position * 8, size)){
+						return false;
+					}
+					uint32_t c = 0;
+					auto output = [&c](const char * data, size_t size){
+						c = crc32::execute(data, data + size, c);
+						return true;
+					};
+					while(true){
+						if(!d.write(pending.data(), pending.size(), output)){
+							return false;
+						}
+						if(d.done()){
+							break;
+						}
+						pending.clear();
+						if(!fill()){
+							fprintf(stderr, "unexpected end of gzip member\n");
+							return false;
+						}
+					}
+					// bytes after deflate data, from trailer
+					std::vector<char> rest = d.buffered();
+					rest.insert(rest.end(), pending.end() - d.unused, pending.end());
+					pending.swap(rest);
+					position = d.total_in - (pending.size() - d.unused);
+					while(pending.size() < TRAILER_SIZE && fill()){
+					}
+					input_type tin(pending.data(), pending.data() + pending.size());
+					uint32_t CRC32, ISIZE;
+					if(!tin.read(CRC32) || !tin.read(ISIZE)){
+						fprintf(stderr, "gzip trailer is not found\n");
+						return false;
+					}
+					if(c != CRC32 || ((d.out.total - size) & 0xFFFFFFFF) != ISIZE){
+						fprintf(stderr, "CRC32 or ISIZE error %08x != %08x\n", c, CRC32);
+						return false;
+					}
+					position += TRAILER_SIZE;
+					pending.erase(pending.begin(), pending.begin() + TRAILER_SIZE);
+					size = d.out.total;
+				}
+				return true;
+			}
+			bool build(const std::vector<char>& input, uint64_t span = DEFAULT_SPAN)
+			{
+				size_t position = 0;
+				return build([&](char * data, size_t size){
+					size_t count = std::min(size, input.size() - position);
+					memcpy(data, input.data() + position, count);
+					position += count;
+					return count;
+				}, span);
+			}
+			bool build(FILE * fp, uint64_t span = DEFAULT_SPAN)
+			{
+				return build([fp](char * data, size_t size){
+					return fread(data, 1, size, fp);
+				}, span);
+			}
+			// nearest checkpoint at or before offset
+			const checkpoint * find(uint64_t offset) const
+			{
+				auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), offset, [](uint64_t offset, const checkpoint& cp){
+					return offset < cp.offset;
+				});
+				return it == checkpoints.begin() ? nullptr : &*(it - 1);
+			}
+			// read at most length bytes from offset of uncompressed data.
+			// seek function moves read function to a byte position of gzip file.
+			bool extract(std::vector<char>& output, uint64_t offset, size_t length, const seek_function& seek, const read_function& read) const
+			{
+				output.clear();
+				const checkpoint * cp = find(offset);
+				if(!cp){
+					fprintf(stderr, "index is empty\n");
+					return false;
+				}
+				uint64_t position = cp->offset; // offset of next output
+				const uint64_t end = offset + length;
+				auto out = [&](const char * data, size_t size){
+					uint64_t begin = std::max(position, offset);
+					position += size;
+					if(begin < std::min(position, end)){
+						output.insert(output.end(), data + (begin - (position - size)), data + (std::min(position, end) - (position - size)));
+					}
+					return true;
+				};
+				std::vector<char> buffer(READ_SIZE);
+				while(position < end){
+					if(!seek(cp->bit_offset / 8)){
+						return false;
+					}
+					deflate::decoder d;
+					if(!d.resume(cp->window.data(), cp->window.size(), cp->bit_offset, cp->offset)){
+						return false;
+					}
+					while(position < end && !d.done()){
+						size_t count = read(buffer.data(), buffer.size());
+						if(!count){
+							fprintf(stderr, "unexpected end of gzip member\n");
+							return false;
+						}
+						if(!d.write(buffer.data(), count, out)){
+							return false;
+						}
+					}
+					// continue from checkpoint at start of next member, if any
+					const checkpoint * next = find(position);
+					if(position < end && (next <= cp || next->offset != position)){
+						break;
+					}
+					cp = next;
+				}
+				return true;
+			}
+			bool extract(std::vector<char>& output, const std::vector<char>& input, uint64_t offset, size_t length) const
+			{
+				size_t position = 0;
+				return extract(output, offset, length, [&](uint64_t p){
+					position = static_cast<size_t>(std::min<uint64_t>(p, input.size()));
+					return true;
+				}, [&](char * data, size_t size){
+					size_t count = std::min(size, input.size() - position);
+					memcpy(data, input.data() + position, count);
+					position += count;
+					return count;
+				});
+			}
+			bool extract(std::vector<char>& output, FILE * fp, uint64_t offset, size_t length) const
+			{
+				return extract(output, offset, length, [fp](uint64_t position){
+#ifdef _MSC_VER
+					return !_fseeki64(fp, static_cast<__int64>(position), SEEK_SET);
+#else
+					return !fseeko(fp, static_cast<off_t>(position), SEEK_SET);
+#endif
+				}, [fp](char * data, size_t size){
+					return fread(data, 1, size, fp);
+				});
+			}
+			// side file: magic, version, span, size, count and checkpoints.
+			// windows are stored deflated.
+			bool serialize(std::vector<char>& output) const
+			{
+				output_type out;
+				out.output.insert(out.output.end(), magic(), magic() + 4);
+				if(!out.write(static_cast<uint32_t>(VERSION)) || !out.write(span) || !out.write(size) || !out.write(static_cast<uint32_t>(checkpoints.size()))){
+					return false;
+				}
+				output.assign(out.output.begin(), out.output.end());
+				std::vector<char> encoded;
+				for(auto& cp : checkpoints){
+					if(!deflate::encode(encoded, cp.window)){
+						return false;
+					}
+					out.output.clear();
+					if(!out.write(cp.bit_offset) || !out.write(cp.offset) || !out.write(static_cast<uint32_t>(encoded.size()))){
+						return false;
+					}
+					output.insert(output.end(), out.output.begin(), out.output.end());
+					output.insert(output.end(), encoded.begin(), encoded.end());
+				}
+				return true;
+			}
+			bool deserialize(const std::vector<char>& input)
+			{
+				input_type in(input.data(), input.data() + input.size());
+				uint32_t version, count;
+				if(in.size() < 4 || memcmp(in.begin, magic(), 4)){
+					fprintf(stderr, "gzip index magic error\n");
+					return false;
+				}
+				in.advance(4);
+				if(!in.read(version) || version != VERSION || !in.read(span) || !in.read(size) || !in.read(count)){
+					fprintf(stderr, "gzip index header error\n");
+					return false;
+				}
+				checkpoints.clear();
+				for(uint32_t i = 0; i < count; ++i){
+					uint64_t bit_offset, offset;
+					uint32_t encoded_size;
+					if(!in.read(bit_offset) || !in.read(offset) || !in.read(encoded_size) || in.size() < encoded_size){
+						fprintf(stderr, "gzip index checkpoint error\n");
+						return false;
+					}
+					checkpoints.push_back(checkpoint(bit_offset, offset));
+					if(!deflate::decode(checkpoints.back().window, {in.begin, in.begin + encoded_size})){
+						return false;
+					}
+					in.advance(encoded_size);
+				}
+				return true;
+			}
+		};
 	};
 }
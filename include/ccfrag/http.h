@@ -11,6 +11,7 @@
 #include <sstream>
 #include <ccfrag/compress.h>
 #include <ccfrag/gzip.h>
+#include <ccfrag/zlib.h>
 
 namespace ccfrag{
 	// specification
@@ -1517,7 +1518,9 @@ namespace ccfrag{
 							}
 							break;
 						case transfer_coding::deflate:
-							if(!ccfrag::deflate::decode(tmp, body)){
+							// "deflate" is zlib format, but some implementations send raw deflate
+							if(!(ccfrag::zlib::is_zlib(body.data(), body.size()) && ccfrag::zlib::decode(tmp, body)) &&
+								!ccfrag::deflate::decode(tmp, body)){
 								return false;
 							}
 							break;
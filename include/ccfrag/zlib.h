@@ -0,0 +1,219 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <ccfrag/deflate.h>
+#include <ccfrag/cpu.h>
+
+namespace ccfrag{
+	// https://tools.ietf.org/html/rfc1950
+	class zlib{
+	public:
+		class adler32
+		{
+		public:
+			enum{
+				BASE = 65521, // largest prime smaller than 65536
+				NMAX = 5552, // largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
+			};
+			static uint32_t execute(const char * begin, const char * end, uint32_t adler = 1)
+			{
+				return kernel()(reinterpret_cast<const uint8_t *>(begin), end - begin, adler);
+			}
+			typedef uint32_t (*kernel_type)(const uint8_t * data, size_t size, uint32_t adler);
+			static uint32_t execute_scalar(const uint8_t * data, size_t size, uint32_t adler)
+			{
+				uint32_t s1 = adler & 0xFFFF;
+				uint32_t s2 = adler >> 16;
+				while(size){
+					size_t n = std::min<size_t>(size, NMAX);
+					size -= n;
+					for(const uint8_t * end = data + n; data != end; ++data){
+						s1 += *data;
+						s2 += s1;
+					}
+					s1 %= BASE;
+					s2 %= BASE;
+				}
+				return (s2 << 16) | s1;
+			}
+#ifdef CCFRAG_X86_64
+			static uint32_t horizontal_sum(__m128i v)
+			{
+				v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+				v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+				return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+			}
+			// for each 16 bytes block, s1 += sum of bytes, s2 += 16 * s1 before block + sum of bytes weighted 16..1
+			static uint32_t execute_sse2(const uint8_t * data, size_t size, uint32_t adler)
+			{
+				uint32_t s1 = adler & 0xFFFF;
+				uint32_t s2 = adler >> 16;
+				size_t blocks = size / 16;
+				size -= blocks * 16;
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i weight_low = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+				const __m128i weight_high = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+				while(blocks){
+					size_t n = std::min<size_t>(blocks, NMAX / 16);
+					blocks -= n;
+					__m128i previous_s1 = _mm_cvtsi32_si128(static_cast<int>(s1 * n)); // sum of s1 before each block
+					__m128i v_s1 = zero;
+					__m128i v_s2 = _mm_cvtsi32_si128(static_cast<int>(s2));
+					for(; n; --n, data += 16){
+						__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+						previous_s1 = _mm_add_epi32(previous_s1, v_s1);
+						v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes, zero));
+						v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weight_low));
+						v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weight_high));
+					}
+					v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(previous_s1, 4));
+					s1 = (s1 + horizontal_sum(v_s1)) % BASE;
+					s2 = horizontal_sum(v_s2) % BASE;
+				}
+				return execute_scalar(data, size, (s2 << 16) | s1);
+			}
+			// same as sse2 by 32 bytes blocks
+			CCFRAG_TARGET("avx2")
+			static uint32_t execute_avx2(const uint8_t * data, size_t size, uint32_t adler)
+			{
+				uint32_t s1 = adler & 0xFFFF;
+				uint32_t s2 = adler >> 16;
+				size_t blocks = size / 32;
+				size -= blocks * 32;
+				const __m256i zero = _mm256_setzero_si256();
+				const __m256i ones = _mm256_set1_epi16(1);
+				const __m256i weight = _mm256_setr_epi8(
+					32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+					16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+				while(blocks){
+					size_t n = std::min<size_t>(blocks, NMAX / 32);
+					blocks -= n;
+					__m256i previous_s1 = _mm256_setr_epi32(static_cast<int>(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+					__m256i v_s1 = zero;
+					__m256i v_s2 = _mm256_setr_epi32(static_cast<int>(s2), 0, 0, 0, 0, 0, 0, 0);
+					for(; n; --n, data += 32){
+						__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+						previous_s1 = _mm256_add_epi32(previous_s1, v_s1);
+						v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+						v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weight), ones));
+					}
+					v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(previous_s1, 5));
+					s1 = (s1 + horizontal_sum(_mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1)))) % BASE;
+					s2 = horizontal_sum(_mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1))) % BASE;
+				}
+				return execute_scalar(data, size, (s2 << 16) | s1);
+			}
+#endif
+			static kernel_type select_kernel()
+			{
+#ifdef CCFRAG_X86_64
+				if(cpu::has_avx2()){
+					return execute_avx2;
+				}
+				return execute_sse2;
+#else
+				return execute_scalar;
+#endif
+			}
+			static kernel_type kernel()
+			{
+				static const kernel_type selected = select_kernel();
+				return selected;
+			}
+		};
+		enum{
+			CM_DEFLATE = 8,
+			CINFO_MAX = 7, // log2 of window size - 8
+			FLG_FDICT = 1 << 5,
+			FLEVEL_SHIFT = 6,
+			FLEVEL_FASTEST = 0,
+			FLEVEL_FAST = 1,
+			FLEVEL_DEFAULT = 2,
+			FLEVEL_MAXIMUM = 3,
+			HEADER_SIZE = 2,
+			DICTID_SIZE = 4,
+			TRAILER_SIZE = 4,
+		};
+		// valid CMF and FLG at beginning of data
+		static bool is_zlib(const char * data, size_t size)
+		{
+			if(size < HEADER_SIZE){
+				return false;
+			}
+			uint8_t CMF = static_cast<uint8_t>(data[0]);
+			uint8_t FLG = static_cast<uint8_t>(data[1]);
+			return (CMF & 0x0F) == CM_DEFLATE && (CMF >> 4) <= CINFO_MAX && (CMF * 256 + FLG) % 31 == 0;
+		}
+		static void write_uint32(std::vector<char>& output, uint32_t value)
+		{
+			for(int shift = 24; 0 <= shift; shift -= 8){
+				output.push_back(static_cast<char>(value >> shift));
+			}
+		}
+		static uint32_t read_uint32(const char * data)
+		{
+			uint32_t value = 0;
+			for(size_t i = 0; i < 4; ++i){
+				value = (value << 8) | static_cast<uint8_t>(data[i]);
+			}
+			return value;
+		}
+		static bool encode(std::vector<char>& output, const std::vector<char>& input, int level = deflate::DEFAULT_LEVEL, const std::vector<char>& dictionary = std::vector<char>())
+		{
+			uint8_t CMF = (CINFO_MAX << 4) | CM_DEFLATE;
+			uint8_t FLEVEL = (level <= deflate::MIN_LEVEL ? FLEVEL_FASTEST : level < deflate::DEFAULT_LEVEL ? FLEVEL_FAST : level == deflate::DEFAULT_LEVEL ? FLEVEL_DEFAULT : FLEVEL_MAXIMUM);
+			uint8_t FLG = static_cast<uint8_t>((FLEVEL << FLEVEL_SHIFT) | (dictionary.empty() ? 0 : FLG_FDICT));
+			FLG |= 31 - (CMF * 256 + FLG) % 31; // FCHECK
+			output.clear();
+			output.push_back(static_cast<char>(CMF));
+			output.push_back(static_cast<char>(FLG));
+			deflate::encoder e(deflate::encoder::parameters::level(level));
+			if(!dictionary.empty()){
+				write_uint32(output, adler32::execute(dictionary.data(), dictionary.data() + dictionary.size()));
+				e.set_dictionary(dictionary.data(), dictionary.size());
+			}
+			if(!e.write(output, input.data(), input.size(), deflate::encoder::FINISH)){
+				return false;
+			}
+			write_uint32(output, adler32::execute(input.data(), input.data() + input.size()));
+			return true;
+		}
+		static bool decode(std::vector<char>& output, const std::vector<char>& input, const std::vector<char>& dictionary = std::vector<char>())
+		{
+			if(!is_zlib(input.data(), input.size())){
+				fprintf(stderr, "zlib header error\n");
+				return false;
+			}
+			const char * begin = input.data() + HEADER_SIZE;
+			const char * end = input.data() + input.size();
+			deflate::decoder d;
+			if(input[1] & FLG_FDICT){
+				if(end - begin < DICTID_SIZE){
+					return false;
+				}
+				uint32_t DICTID = read_uint32(begin);
+				begin += DICTID_SIZE;
+				if(dictionary.empty() || DICTID != adler32::execute(dictionary.data(), dictionary.data() + dictionary.size())){
+					fprintf(stderr, "zlib preset dictionary %08x is not given\n", DICTID);
+					return false;
+				}
+				d.set_dictionary(dictionary.data(), dictionary.size());
+			}
+			output.clear();
+			if(!d.write(output, begin, end - begin)){
+				return false;
+			}
+			if(!d.done() || d.unused < TRAILER_SIZE){
+				fprintf(stderr, "unexpected end of zlib stream\n");
+				return false;
+			}
+			uint32_t ADLER32 = read_uint32(end - d.unused);
+			uint32_t adler = adler32::execute(output.data(), output.data() + output.size());
+			if(ADLER32 != adler){
+				fprintf(stderr, "ADLER32 error %08x != %08x\n", adler, ADLER32);
+				return false;
+			}
+			return true;
+		}
+	};
+}
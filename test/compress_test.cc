@@ -0,0 +1,45 @@
+#include <ccfrag/compress.h>
+#include <vector>
+#include "test.h"
+
+using namespace ccfrag;
+
+// stationary input keeps compression ratio after table is full, so no CLEAR is sent
+static bool test_stationary(size_t alphabet)
+{
+	std::vector<char> data = test_random_data(1000000, 9, alphabet);
+	compress::encoder e;
+	std::vector<char> encoded;
+	size_t full_at = 0;
+	for(size_t i = 0; i < data.size(); i += 4096){
+		if(!e.write(encoded, data.data() + i, std::min<size_t>(4096, data.size() - i))){
+			return false;
+		}
+		if(!full_at && e.max_code < e.next_code){
+			full_at = e.bytes_in;
+		} else if(full_at && e.next_code <= e.max_code){
+			fprintf(stderr, "compress: CLEAR at %zd after table is full at %zd, alphabet %zd\n", static_cast<size_t>(e.bytes_in), full_at, alphabet);
+			return false;
+		}
+	}
+	if(!full_at || data.size() < full_at + compress::encoder::CHECK_GAP * 2 || !e.finish(encoded)){
+		fprintf(stderr, "compress: table is not full, alphabet %zd\n", alphabet);
+		return false;
+	}
+	compress::decoder d;
+	std::vector<char> decoded;
+	if(!d.write(decoded, encoded.data(), encoded.size()) || decoded != data){
+		fprintf(stderr, "compress: decode error, alphabet %zd\n", alphabet);
+		return false;
+	}
+	return true;
+}
+
+bool compress_test()
+{
+	if(!test_stationary(256)) return false;
+	if(!test_stationary(8)) return false;
+	return true;
+}
+
+TEST(compress_test);
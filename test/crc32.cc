@@ -0,0 +1,85 @@
+#include <ccfrag/gzip.h>
+#include <vector>
+#include "test.h"
+
+using namespace ccfrag;
+
+// every kernel available on this cpu agrees with byte-wise crc for each length, alignment and initial register
+static bool test_crc32_kernels()
+{
+	static const char check[] = "123456789";
+	if(gzip::crc32::execute(check, check + 9) != 0xCBF43926){
+		fprintf(stderr, "crc32 error\n");
+		return false;
+	}
+	typedef gzip::crc32::kernel_type kernel_type;
+	std::vector<std::pair<const char *, kernel_type>> kernels;
+	kernels.push_back(std::make_pair("slice8", &gzip::crc32::execute_slice8));
+	kernels.push_back(std::make_pair("slice16", &gzip::crc32::execute_slice16));
+#ifdef CCFRAG_CRC32_PCLMUL
+	if(cpu::has_pclmul()){
+		kernels.push_back(std::make_pair("pclmul", &gzip::crc32::execute_pclmul));
+	}
+#endif
+#ifdef CCFRAG_CRC32_ARM
+	if(cpu::has_crc32()){
+		kernels.push_back(std::make_pair("arm", &gzip::crc32::execute_arm));
+	}
+#endif
+	kernels.push_back(std::make_pair("selected", gzip::crc32::kernel()));
+	std::vector<char> data = test_random_data(1 << 20, 5);
+	const uint8_t * bytes = reinterpret_cast<const uint8_t *>(data.data());
+	std::vector<size_t> sizes;
+	for(size_t size = 0; size <= 300; ++size){
+		sizes.push_back(size);
+	}
+	for(size_t size : {4095, 4096, 65535, 65536 + 7, (1 << 20) - 16}){
+		sizes.push_back(size);
+	}
+	for(size_t size : sizes){
+		for(size_t offset = 0; offset < 16; ++offset){
+			for(uint32_t c : {0xFFFFFFFFU, 0x12345678U}){
+				const uint32_t expected = gzip::crc32::execute_bytes(bytes + offset, size, c);
+				for(auto& kernel : kernels){
+					if(kernel.second(bytes + offset, size, c) != expected){
+						fprintf(stderr, "crc32 %s kernel error size=%zd offset=%zd\n", kernel.first, size, offset);
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// crc of a + b from crc of a and crc of b at every split point, including empty a or b
+static bool test_crc32_combine()
+{
+	std::vector<char> data = test_random_data(300000, 5);
+	const char * begin = data.data();
+	for(size_t size : {0, 1, 1000, 300000}){
+		const uint32_t expected = gzip::crc32::execute(begin, begin + size);
+		for(size_t split = 0; split <= size; split += (size < 2000 ? 1 : 997)){
+			uint32_t crc1 = gzip::crc32::execute(begin, begin + split);
+			uint32_t crc2 = gzip::crc32::execute(begin + split, begin + size);
+			if(gzip::crc32::combine(crc1, crc2, size - split) != expected){
+				fprintf(stderr, "crc32 combine error size=%zd split=%zd\n", size, split);
+				return false;
+			}
+		}
+		if(gzip::crc32::combine(expected, gzip::crc32::execute(begin, begin), 0) != expected){
+			fprintf(stderr, "crc32 combine error size=%zd with empty data\n", size);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool crc32_test()
+{
+	if(!test_crc32_kernels()) return false;
+	if(!test_crc32_combine()) return false;
+	return true;
+}
+
+TEST(crc32_test);
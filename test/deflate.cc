@@ -0,0 +1,460 @@
+#include <ccfrag/deflate.h>
+#include <ccfrag/dictionary.h>
+#include <vector>
+#include <string>
+#include "test.h"
+
+using namespace ccfrag;
+
+// runs of short patterns to make references with small distances
+std::vector<char> pattern_data()
+{
+	std::vector<char> data;
+	for(size_t period = 1; period <= 20; ++period){
+		for(size_t length = 1; length <= 300; length += 13){
+			for(size_t i = 0; i < period + length; ++i){
+				data.push_back(static_cast<char>('a' + (period * 7 + length + i % period) % 26));
+			}
+		}
+	}
+	return data;
+}
+
+bool test_decode(const std::vector<char>& encoded, const char * begin, const char * end, const char * name)
+{
+	std::vector<char> decoded;
+	if(!deflate::decode(decoded, encoded)){
+		fprintf(stderr, "%s: decode error\n", name);
+		return false;
+	}
+	if(decoded != std::vector<char>(begin, end)){
+		fprintf(stderr, "%s: different %zd != %zd\n", name, decoded.size(), static_cast<size_t>(end - begin));
+		return false;
+	}
+	return true;
+}
+
+bool test_levels(const std::vector<char>& data)
+{
+	for(int level = deflate::MIN_LEVEL; level <= deflate::MAX_LEVEL; ++level){
+		std::vector<char> encoded;
+		if(!deflate::encode(encoded, data, level)){
+			fprintf(stderr, "level %d: encode error\n", level);
+			return false;
+		}
+		if(!test_decode(encoded, data.data(), data.data() + data.size(), "level")){
+			return false;
+		}
+	}
+	return true;
+}
+
+bool test_stream(const std::vector<char>& data, deflate::encoder::flush_type flush)
+{
+	deflate::encoder e;
+	std::vector<char> encoded;
+	size_t flushed_input = 0;
+	size_t flushed_output = 0;
+	for(size_t offset = 0, chunk = 1; offset < data.size(); offset += chunk, chunk = chunk * 3 + 1){
+		chunk = std::min(chunk, data.size() - offset);
+		if(!e.write(encoded, data.data() + offset, chunk, flush)){
+			fprintf(stderr, "stream %d: write error\n", flush);
+			return false;
+		}
+		if(flush == deflate::encoder::SYNC_FLUSH || flush == deflate::encoder::FULL_FLUSH){
+			static const char empty_stored_block[4] = {0, 0, -1, -1};
+			if(encoded.size() < 4 || !std::equal(empty_stored_block, empty_stored_block + 4, encoded.end() - 4)){
+				fprintf(stderr, "stream %d: not flushed\n", flush);
+				return false;
+			}
+			flushed_input = offset + chunk;
+			flushed_output = encoded.size();
+		}
+	}
+	if(!e.finish(encoded)){
+		fprintf(stderr, "stream %d: finish error\n", flush);
+		return false;
+	}
+	if(e.write(encoded, data.data(), data.size())){
+		fprintf(stderr, "stream %d: write after finish\n", flush);
+		return false;
+	}
+	if(!test_decode(encoded, data.data(), data.data() + data.size(), "stream")){
+		return false;
+	}
+	if(flush == deflate::encoder::FULL_FLUSH){
+		// output after full flush does not refer preceding data
+		std::vector<char> tail(encoded.begin() + flushed_output, encoded.end());
+		if(!test_decode(tail, data.data() + flushed_input, data.data() + data.size(), "full flush")){
+			return false;
+		}
+	}
+	return true;
+}
+
+bool test_inflate_stream(const std::vector<char>& data, int level)
+{
+	std::vector<char> encoded;
+	if(!deflate::encode(encoded, data, level)){
+		fprintf(stderr, "inflate stream: encode error\n");
+		return false;
+	}
+	// bytes after end of stream are left unused
+	static const char trailer[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	encoded.insert(encoded.end(), trailer, trailer + 8);
+	for(size_t fragment = 1; fragment <= 4096; fragment *= 4){
+		deflate::decoder d;
+		std::vector<char> decoded;
+		size_t offset = 0;
+		for(; offset < encoded.size() && !d.done(); offset += fragment){
+			if(!d.write(decoded, encoded.data() + offset, std::min(fragment, encoded.size() - offset))){
+				fprintf(stderr, "inflate stream %zd: decode error\n", fragment);
+				return false;
+			}
+		}
+		if(!d.done() || decoded != data || d.out.total != data.size()){
+			fprintf(stderr, "inflate stream %zd: different %zd != %zd\n", fragment, decoded.size(), data.size());
+			return false;
+		}
+		if(d.total_in + d.unused + (encoded.size() - std::min(offset, encoded.size())) != encoded.size() || d.total_in + 8 + 7 < encoded.size()){
+			fprintf(stderr, "inflate stream %zd: consumed %llu unused %zd\n", fragment, static_cast<unsigned long long>(d.total_in), d.unused);
+			return false;
+		}
+	}
+	return true;
+}
+
+// small json documents sharing keys and values
+std::vector<char> rpc_data(uint32_t& seed)
+{
+	static const char * names[] = {"alice", "bob", "carol", "dave"};
+	static const char * states[] = {"active", "pending", "suspended"};
+	std::string document = "{\"jsonrpc\":\"2.0\",\"method\":\"user.update\",\"params\":{\"users\":[";
+	for(size_t i = 0, count = 1 + seed % 8; i < count; ++i){
+		seed = seed * 1103515245 + 12345;
+		document += (i ? ",{\"user_id\":" : "{\"user_id\":") + std::to_string(seed % 100000) +
+			",\"name\":\"" + names[(seed >> 8) % 4] + "\",\"status\":\"" + states[(seed >> 12) % 3] + "\",\"roles\":[\"reader\",\"writer\"]}";
+	}
+	document += "]}}";
+	return std::vector<char>(document.begin(), document.end());
+}
+
+bool test_dictionary()
+{
+	uint32_t seed = 1;
+	std::vector<std::vector<char>> samples;
+	for(size_t i = 0; i < 200; ++i){
+		samples.push_back(rpc_data(seed));
+	}
+	std::vector<char> dictionary;
+	if(!dictionary::train(dictionary, samples, dictionary::parameters(4096)) || dictionary.empty() || 4096 < dictionary.size()){
+		fprintf(stderr, "dictionary: train error %zd\n", dictionary.size());
+		return false;
+	}
+	size_t plain_size = 0;
+	size_t dictionary_size = 0;
+	for(size_t i = 0; i < 100; ++i){
+		std::vector<char> data = rpc_data(seed);
+		std::vector<char> plain, encoded, decoded;
+		if(!deflate::encode(plain, data) || !deflate::encode(encoded, data, deflate::DEFAULT_LEVEL, dictionary)){
+			fprintf(stderr, "dictionary: encode error\n");
+			return false;
+		}
+		if(!deflate::decode(decoded, encoded, dictionary) || decoded != data){
+			fprintf(stderr, "dictionary: decode error\n");
+			return false;
+		}
+		plain_size += plain.size();
+		dictionary_size += encoded.size();
+	}
+	if(plain_size < dictionary_size * 2){
+		fprintf(stderr, "dictionary: %zd bytes with dictionary, %zd bytes without\n", dictionary_size, plain_size);
+		return false;
+	}
+	return true;
+}
+
+// match may start at the last bytes of dictionary, they are inserted when input follows them
+bool test_dictionary_end()
+{
+	std::vector<char> dictionary = test_random_data(1000, 4, 24, 'c');
+	dictionary.push_back('a');
+	dictionary.push_back('b');
+	std::vector<char> data;
+	for(size_t i = 0; i < 50; ++i){
+		data.push_back('a');
+		data.push_back('b');
+	}
+	for(int level = deflate::MIN_LEVEL; level <= deflate::OPTIMAL_LEVEL; ++level){
+		deflate::encoder e(deflate::encoder::parameters::level(level));
+		std::vector<char> encoded, decoded;
+		if(!e.set_dictionary(dictionary.data(), dictionary.size()) || !e.write(encoded, data.data(), data.size(), deflate::encoder::FINISH)){
+			fprintf(stderr, "dictionary end: encode error\n");
+			return false;
+		}
+		if(!deflate::decode(decoded, encoded, dictionary) || decoded != data){
+			fprintf(stderr, "dictionary end: decode error\n");
+			return false;
+		}
+		const auto& tokens = level == deflate::OPTIMAL_LEVEL ? e.parser.best.tokens : e.block.tokens;
+		if(tokens.empty() || !tokens.front().length){
+			fprintf(stderr, "dictionary end: level %d does not match from end of dictionary\n", level);
+			return false;
+		}
+	}
+	return true;
+}
+
+// reused encoder and decoder must behave as new ones
+bool test_reset()
+{
+	uint32_t seed = 2;
+	std::vector<std::vector<char>> inputs;
+	inputs.push_back(rpc_data(seed));
+	inputs.push_back(test_text_data(300000, 1));
+	inputs.push_back(rpc_data(seed));
+	inputs.push_back(pattern_data());
+	inputs.push_back(std::vector<char>());
+	inputs.push_back(rpc_data(seed));
+	deflate::encoder e;
+	deflate::decoder d;
+	for(size_t i = 0; i < inputs.size(); ++i){
+		const auto& data = inputs[i];
+		std::vector<char> expected, encoded, decoded;
+		if(!deflate::encode(expected, data)){
+			return false;
+		}
+		e.reset();
+		if(!e.write(encoded, data.data(), data.size(), deflate::encoder::FINISH) || encoded != expected){
+			fprintf(stderr, "reset: encode error %zd\n", i);
+			return false;
+		}
+		d.reset();
+		if(!d.write(decoded, encoded.data(), encoded.size()) || !d.done() || decoded != data){
+			fprintf(stderr, "reset: decode error %zd\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+// inflate from a block boundary with the window saved at the boundary
+bool test_resume(const std::vector<char>& data)
+{
+	std::vector<char> encoded;
+	if(!deflate::encode(encoded, data)){
+		return false;
+	}
+	uint64_t bit_offset = 0;
+	uint64_t offset = 0;
+	std::vector<char> window;
+	deflate::decoder d;
+	d.block_callback = [&](const deflate::decoder& current){
+		if(!offset && data.size() / 2 <= current.out.total){
+			bit_offset = current.bit_position();
+			offset = current.out.total;
+			size_t count = std::min<size_t>(current.out.size, deflate::WINDOW_SIZE);
+			window.assign(current.out.window.data() + current.out.size - count, current.out.window.data() + current.out.size);
+		}
+		return true;
+	};
+	std::vector<char> decoded;
+	if(!d.write(decoded, encoded.data(), encoded.size()) || decoded != data || !offset){
+		fprintf(stderr, "resume: no block boundary\n");
+		return false;
+	}
+	deflate::decoder r;
+	decoded.clear();
+	if(!r.resume(window.data(), window.size(), bit_offset, offset) ||
+		!r.write(decoded, encoded.data() + bit_offset / 8, encoded.size() - bit_offset / 8) || !r.done()){
+		fprintf(stderr, "resume: decode error\n");
+		return false;
+	}
+	if(decoded.size() != data.size() - offset || !std::equal(decoded.begin(), decoded.end(), data.begin() + offset) ||
+		r.out.total != data.size() || r.bit_position() != d.bit_position()){
+		fprintf(stderr, "resume: data error\n");
+		return false;
+	}
+	return true;
+}
+
+// word and simd match length against byte by byte comparison
+bool test_match()
+{
+	typedef deflate::encoder::input_type input_type;
+	std::vector<char> lhs(deflate::MAX_LENGTH + 64, 'a');
+	for(size_t length = 0; length <= deflate::MAX_LENGTH; ++length){
+		for(size_t max_length : {length, length + 1, static_cast<size_t>(deflate::MAX_LENGTH)}){
+			std::vector<char> rhs(lhs);
+			rhs[length] = 'b';
+			size_t expected = std::min(length, max_length);
+			if(input_type(lhs.data(), lhs.data() + lhs.size()).match(input_type(rhs.data(), rhs.data() + rhs.size()), max_length) != expected ||
+				input_type::match_words(lhs.data(), rhs.data(), max_length) != expected ||
+				input_type::match_kernel()(lhs.data(), rhs.data(), max_length) != expected){
+				fprintf(stderr, "match: length %zd max %zd error\n", length, max_length);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// symbol tables cover every length and distance with extra bits
+bool test_symbols()
+{
+	size_t bits, data;
+	for(size_t length = deflate::MIN_LENGTH; length <= deflate::MAX_LENGTH; ++length){
+		size_t symbol = deflate::length_symbol(length, bits, data);
+		if(symbol <= deflate::END_OF_BLOCK || 285 < symbol || deflate::length_base()[symbol - 257] + data != length || (data >> bits) ||
+			(length == deflate::MAX_LENGTH && symbol != 285)){
+			fprintf(stderr, "symbols: length %zd error\n", length);
+			return false;
+		}
+	}
+	for(size_t distance = deflate::MIN_DISTANCE; distance <= deflate::MAX_DISTANCE; ++distance){
+		size_t symbol = deflate::distance_symbol(distance, bits, data);
+		if(29 < symbol || deflate::distance_base()[symbol] + data != distance || (data >> bits)){
+			fprintf(stderr, "symbols: distance %zd error\n", distance);
+			return false;
+		}
+	}
+	return true;
+}
+
+// huffman only and rle restrict matches, incompressible data is stored without expansion over block headers
+bool test_strategy()
+{
+	typedef deflate::encoder::parameters parameters;
+	// random bytes first
+	std::vector<std::vector<char>> inputs(1, test_random_data(300000, 3));
+	inputs.push_back(std::vector<char>());
+	for(size_t length = 1; inputs.back().size() < 300000; length = length % 1000 + 1){
+		inputs.back().insert(inputs.back().end(), length, static_cast<char>(length));
+	}
+	inputs.push_back(test_text_data(300000, 1));
+	inputs.push_back(pattern_data());
+	for(auto strategy : {deflate::encoder::STRATEGY_DEFAULT, deflate::encoder::STRATEGY_HUFFMAN_ONLY, deflate::encoder::STRATEGY_RLE}){
+		parameters params = parameters::level(deflate::DEFAULT_LEVEL);
+		params.strategy = strategy;
+		for(const auto& data : inputs){
+			std::vector<char> encoded;
+			if(!deflate::encoder::encode(encoded, data, params)){
+				fprintf(stderr, "strategy %d: encode error\n", strategy);
+				return false;
+			}
+			if(!test_decode(encoded, data.data(), data.data() + data.size(), "strategy")){
+				return false;
+			}
+			if(&data == &inputs.front() && data.size() + 5 * (data.size() / deflate::MAX_BLOCK_SIZE + 1) < encoded.size()){
+				fprintf(stderr, "strategy %d: random data expanded to %zd\n", strategy, encoded.size());
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// optimal parse is not larger than level 9
+bool test_optimal()
+{
+	for(const auto& data : {test_text_data(300000, 1), pattern_data(), test_text_data(1, 1), std::vector<char>()}){
+		std::vector<char> encoded, best;
+		if(!deflate::encode(encoded, data, deflate::OPTIMAL_LEVEL) || !deflate::encode(best, data, deflate::MAX_LEVEL)){
+			fprintf(stderr, "optimal: encode error\n");
+			return false;
+		}
+		if(!test_decode(encoded, data.data(), data.data() + data.size(), "optimal")){
+			return false;
+		}
+		if(best.size() < encoded.size()){
+			fprintf(stderr, "optimal: %zd larger than level 9 %zd\n", encoded.size(), best.size());
+			return false;
+		}
+	}
+	return true;
+}
+
+// write huffman code from its most significant bit
+static void write_code(bitstream::output_type& out, uint32_t code, size_t length)
+{
+	while(length){
+		--length;
+		out.write((code >> length) & 1, 1);
+	}
+}
+
+// dynamic block header with 257 literal/length codes and a distance code,
+// literals of 9 bits and end of block of 1 bit, distance code is repeated by last_repeat if it is given
+static std::vector<char> dynamic_block(size_t HLIT, size_t last_repeat)
+{
+	bitstream::output_type out;
+	out.write(1, 1); // BFINAL
+	out.write(deflate::BTYPE_DYNAMIC_HUFFMAN_CODES, 2);
+	out.write(HLIT - 257, 5);
+	out.write(0, 5); // HDIST 1
+	out.write(18 - 4, 4); // HCLEN up to code length code 1
+	// code length codes 9: 0, 1: 10, 16: 11
+	for(size_t symbol : {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1}){
+		out.write(symbol == 9 ? 1 : symbol == 16 || symbol == 1 ? 2 : 0, 3);
+	}
+	write_code(out, 0, 1); // 9
+	for(size_t count = 1; count < 256; count += 3){
+		write_code(out, 3, 2); // 16, repeat 3 times
+		out.write(0, 2);
+	}
+	write_code(out, 2, 2); // 1 of end of block
+	if(last_repeat){
+		write_code(out, 3, 2); // 16 from distance code 0 beyond HLIT + HDIST
+		out.write(last_repeat - 3, 2);
+	} else{
+		write_code(out, 2, 2); // 1 of distance code 0
+	}
+	write_code(out, 0, 1); // end of block
+	out.flush();
+	return out.output;
+}
+
+// malformed dynamic block headers are rejected
+bool test_invalid()
+{
+	std::vector<char> decoded;
+	if(!deflate::decode(decoded, dynamic_block(257, 0)) || !decoded.empty()){
+		fprintf(stderr, "invalid: valid block is not decoded\n");
+		return false;
+	}
+	if(deflate::decode(decoded, dynamic_block(287, 0))){
+		fprintf(stderr, "invalid: HLIT 287 is accepted\n");
+		return false;
+	}
+	if(deflate::decode(decoded, dynamic_block(257, 3))){
+		fprintf(stderr, "invalid: repeat beyond HLIT + HDIST is accepted\n");
+		return false;
+	}
+	return true;
+}
+
+bool deflate_test()
+{
+	if(!test_symbols()) return false;
+	if(!test_match()) return false;
+	if(!test_levels(std::vector<char>())) return false;
+	if(!test_levels(test_text_data(1, 1))) return false;
+	if(!test_levels(test_text_data(300000, 1))) return false;
+	if(!test_levels(pattern_data())) return false;
+	if(!test_stream(test_text_data(300000, 1), deflate::encoder::NO_FLUSH)) return false;
+	if(!test_stream(test_text_data(300000, 1), deflate::encoder::SYNC_FLUSH)) return false;
+	if(!test_stream(test_text_data(300000, 1), deflate::encoder::FULL_FLUSH)) return false;
+	if(!test_inflate_stream(std::vector<char>(), deflate::DEFAULT_LEVEL)) return false;
+	if(!test_inflate_stream(test_text_data(300000, 1), 1)) return false;
+	if(!test_inflate_stream(test_text_data(300000, 1), deflate::MAX_LEVEL)) return false;
+	if(!test_dictionary()) return false;
+	if(!test_dictionary_end()) return false;
+	if(!test_reset()) return false;
+	if(!test_resume(test_text_data(300000, 1))) return false;
+	if(!test_strategy()) return false;
+	if(!test_optimal()) return false;
+	if(!test_invalid()) return false;
+	return true;
+}
+
+TEST(deflate_test);
@@ -0,0 +1,49 @@
+#include <ccfrag/dictionary.h>
+#include <string>
+#include <cstdlib>
+
+using namespace ccfrag;
+
+// dictionary [-s size] [-l] sample files...
+// write preset dictionary trained from sample files to stdout.
+// -l : each line of files is a sample
+int main(int argc, char *argv[])
+{
+	FILE * fout = stdout;
+	dictionary::parameters params;
+	bool lines = false;
+	std::vector<std::vector<char>> samples;
+	for(int i = 1; i < argc; ++i){
+		if(std::string("-s") == argv[i] && i + 1 < argc){
+			params = dictionary::parameters(static_cast<size_t>(atoi(argv[++i])));
+		} else if(std::string("-l") == argv[i]){
+			lines = true;
+		} else{
+			FILE * fin = fopen(argv[i], "rb");
+			if(!fin){
+				fprintf(stderr, "failed to open %s\n", argv[i]);
+				return -1;
+			}
+			std::vector<char> sample;
+			int c;
+			while((c = fgetc(fin)) != EOF){
+				sample.push_back(static_cast<char>(c));
+				if(lines && c == '\n'){
+					samples.push_back(sample);
+					sample.clear();
+				}
+			}
+			fclose(fin);
+			if(!sample.empty()){
+				samples.push_back(sample);
+			}
+		}
+	}
+	std::vector<char> output;
+	if(!dictionary::train(output, samples, params)){
+		fprintf(stderr, "no frequent substrings in %zd samples\n", samples.size());
+		return -1;
+	}
+	fwrite(output.data(), 1, output.size(), fout);
+	return 0;
+}
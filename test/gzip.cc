@@ -6,6 +6,38 @@ int main(int argc, char *argv[])
 {
 	FILE * fin = stdin;
 	FILE * fout = stdout;
+	bool decode = false;
+	bool blocked = false;
+	int level = deflate::DEFAULT_LEVEL;
+	size_t threads = 1;
+	for(int i = 1; i < argc; ++i){
+		if(std::string("-d") == argv[i]){
+			decode = true;
+		} else if(std::string("-b") == argv[i]){
+			blocked = true;
+		} else if(std::string("--max") == argv[i]){
+			level = deflate::OPTIMAL_LEVEL;
+		} else if(std::string("-p") == argv[i] && i + 1 < argc){
+			threads = std::max(1, atoi(argv[++i]));
+		} else if(argv[i][0] == '-' && '1' <= argv[i][1] && argv[i][1] <= '9' && !argv[i][2]){
+			level = argv[i][1] - '0';
+		}
+	}
+	if(decode && threads == 1){
+		// inflate as input arrives
+		gzip::decoder d;
+		std::vector<char> input(64 * 1024);
+		size_t size;
+		auto output = [fout](const char * data, size_t size){
+			return fwrite(data, 1, size, fout) == size;
+		};
+		while((size = fread(input.data(), 1, input.size(), fin)) != 0){
+			if(!d.write(input.data(), size, output)){
+				return -1;
+			}
+		}
+		return d.done() ? 0 : -1;
+	}
 	int c;
 	std::deque<char> input;
 	while((c = fgetc(fin)) != EOF){
@@ -13,18 +45,20 @@ int main(int argc, char *argv[])
 	}
 	std::vector<char> input_data(input.begin(), input.end());
 	std::vector<char> output;
-	bool decode = false;
-	for(int i = 1; i < argc; ++i){
-		if(std::string("-d") == argv[i]){
-			decode = true;
-		}
-	}
 	if(decode){
-		if(!gzip::decode(output, input_data)){
+		if(gzip::is_blocked(input_data.data(), input_data.size())){
+			if(!gzip::decode_blocked(output, input_data, threads)){
+				return -1;
+			}
+		} else if(!gzip::decode(output, input_data)){
+			return -1;
+		}
+	}else if(blocked){
+		if(!gzip::encode_blocked(output, input_data, level, threads)){
 			return -1;
 		}
 	}else{
-		if(!gzip::encode(output, input_data)){
+		if(!gzip::encode(output, input_data, level, threads)){
 			return -1;
 		}
 	}
@@ -16,4 +16,113 @@ if [ $? != 0 ] ; then
  return 1
 fi
 
-rm .tmp
+for level in -1 -9 ; do
+ cat gzip | ./gzip $level | gunzip > .tmp
+ diff .tmp gzip &> /dev/null
+ if [ $? != 0 ] ; then
+  rm .tmp
+  echo compress $level error
+  return 1
+ fi
+done
+
+for threads in 1 3 ; do
+ cat gzip | ./gzip -p $threads | gunzip > .tmp
+ diff .tmp gzip &> /dev/null
+ if [ $? != 0 ] ; then
+  rm .tmp
+  echo compress -p $threads error
+  return 1
+ fi
+done
+
+for threads in 1 3 ; do
+ cat gzip | ./gzip -b -p $threads | gunzip > .tmp
+ cmp -s .tmp gzip
+ if [ $? != 0 ] ; then
+  rm .tmp
+  echo blocked compress -p $threads error
+  return 1
+ fi
+ cat gzip | ./gzip -b | ./gzip -d -p $threads > .tmp
+ cmp -s .tmp gzip
+ if [ $? != 0 ] ; then
+  rm .tmp
+  echo blocked uncompress -p $threads error
+  return 1
+ fi
+done
+
+# truncated trailer is not accepted as end of gzip
+cat gzip | gzip > .tmp.gz
+size=`wc -c < .tmp.gz`
+head -c `expr $size - 4` .tmp.gz | ./gzip -d > .tmp 2> /dev/null
+if [ $? = 0 ] ; then
+ rm .tmp .tmp.gz
+ echo truncated trailer error
+ return 1
+fi
+rm .tmp.gz
+
+# end of file marker does not depend on level
+for level in -1 -9 ; do
+ cat gzip | ./gzip -b $level | tail -c 28 > .tmp
+ printf '\037\213\010\004\000\000\000\000\000\377\006\000\102\103\002\000\033\000\003\000\000\000\000\000\000\000\000\000' | cmp -s .tmp -
+ if [ $? != 0 ] ; then
+  rm .tmp
+  echo blocked $level end of file marker error
+  return 1
+ fi
+done
+
+# empty blocked members with ISIZE 0x40000000 are rejected before output is allocated
+for i in 1 2 3 4 ; do
+ printf '\037\213\010\004\000\000\000\000\000\377\006\000\102\103\002\000\033\000\003\000\000\000\000\000\000\000\000\100'
+done | ./gzip -d -p 2 > .tmp 2> /dev/null
+if [ $? != 255 ] ; then
+ rm .tmp
+ echo blocked ISIZE error
+ return 1
+fi
+
+cat gzip | ./gzip --max | gunzip > .tmp
+cmp -s .tmp gzip
+if [ $? != 0 ] ; then
+ rm .tmp
+ echo compress --max error
+ return 1
+fi
+
+(cat gzip | gzip ; cat gzip | ./gzip -1) | ./gzip -d > .tmp
+cat gzip gzip | cmp -s .tmp -
+if [ $? != 0 ] ; then
+ rm .tmp
+ echo multi member uncompress error
+ return 1
+fi
+
+# a member followed by blocked members, extract may cross member boundary
+cat gzip gzip_index gzip > .tmp.in
+gzip < .tmp.in > .tmp.gz
+first=`wc -c < .tmp.in`
+cat gzip_index gzip gzip_index | tee -a .tmp.in | ./gzip -b >> .tmp.gz
+size=`wc -c < .tmp.in`
+./gzip_index build .tmp.gz .tmp.idx 65536
+for offset in 0 `expr $size / 3` `expr $first - 2500` `expr $size \* 2 / 3` `expr $size - 5000` ; do
+ ./gzip_index extract .tmp.gz .tmp.idx $offset 5000 > .tmp
+ tail -c +`expr $offset + 1` .tmp.in | head -c 5000 | cmp -s .tmp -
+ if [ $? != 0 ] ; then
+  rm .tmp .tmp.in .tmp.gz .tmp.idx
+  echo index $offset error
+  return 1
+ fi
+done
+printf 'junk' >> .tmp.gz
+./gzip_index build .tmp.gz .tmp.idx 65536 2> /dev/null
+if [ $? = 0 ] ; then
+ rm .tmp .tmp.in .tmp.gz .tmp.idx
+ echo index trailing garbage error
+ return 1
+fi
+
+rm .tmp .tmp.in .tmp.gz .tmp.idx
@@ -0,0 +1,55 @@
+#include <ccfrag/gzip.h>
+#include <cstdlib>
+
+using namespace ccfrag;
+
+// gzip_index build file.gz index [span]
+// gzip_index extract file.gz index offset length
+int main(int argc, char *argv[])
+{
+	if(argc < 4){
+		fprintf(stderr, "usage: %s build file.gz index [span]\n", argv[0]);
+		fprintf(stderr, "       %s extract file.gz index offset length\n", argv[0]);
+		return -1;
+	}
+	std::string command = argv[1];
+	FILE * fin = fopen(argv[2], "rb");
+	if(!fin){
+		fprintf(stderr, "failed to open %s\n", argv[2]);
+		return -1;
+	}
+	gzip::index idx;
+	std::vector<char> data;
+	if(command == "build"){
+		uint64_t span = 4 < argc ? strtoull(argv[4], nullptr, 10) : gzip::index::DEFAULT_SPAN;
+		if(!idx.build(fin, span) || !idx.serialize(data)){
+			return -1;
+		}
+		FILE * fout = fopen(argv[3], "wb");
+		if(!fout){
+			return -1;
+		}
+		fwrite(data.data(), 1, data.size(), fout);
+		fclose(fout);
+		fprintf(stderr, "%zd checkpoints, %zd bytes index for %llu bytes\n", idx.checkpoints.size(), data.size(), static_cast<unsigned long long>(idx.size));
+	} else if(command == "extract" && 5 < argc){
+		FILE * fidx = fopen(argv[3], "rb");
+		if(!fidx){
+			return -1;
+		}
+		int c;
+		while((c = fgetc(fidx)) != EOF){
+			data.push_back(static_cast<char>(c));
+		}
+		fclose(fidx);
+		std::vector<char> output;
+		if(!idx.deserialize(data) || !idx.extract(output, fin, strtoull(argv[4], nullptr, 10), static_cast<size_t>(strtoull(argv[5], nullptr, 10)))){
+			return -1;
+		}
+		fwrite(output.data(), 1, output.size(), stdout);
+	} else{
+		return -1;
+	}
+	fclose(fin);
+	return 0;
+}
@@ -1,5 +1,33 @@
 #include <functional>
 #include <list>
+#include <vector>
+#include <string>
+#include <cstdint>
+// pseudo random bytes below alphabet from first, same for a seed on every platform
+inline std::vector<char> test_random_data(size_t size, uint32_t seed, size_t alphabet = 256, char first = 0)
+{
+	std::vector<char> data(size);
+	for(auto& c : data){
+		seed = seed * 1103515245 + 12345;
+		c = static_cast<char>(first + (seed >> 24) % alphabet);
+	}
+	return data;
+}
+// json like records with a random byte at times, compressible as text
+inline std::vector<char> test_text_data(size_t size, uint32_t seed)
+{
+	std::vector<char> data;
+	while(data.size() < size){
+		seed = seed * 1103515245 + 12345;
+		std::string word = "{\"id\":" + std::to_string(seed % 1000) + ",\"name\":\"item" + std::to_string((seed >> 10) % 100) + "\"},";
+		data.insert(data.end(), word.begin(), word.end());
+		if(seed % 7 == 0){
+			data.push_back(static_cast<char>(seed >> 24));
+		}
+	}
+	data.resize(size);
+	return data;
+}
 class test_framework{
 public:
 	typedef std::function<bool ()> test_function;
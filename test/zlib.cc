@@ -0,0 +1,92 @@
+#include <ccfrag/zlib.h>
+#include <vector>
+#include <string>
+#include "test.h"
+
+using namespace ccfrag;
+
+static bool test_adler32()
+{
+	static const char wikipedia[] = "Wikipedia";
+	if(zlib::adler32::execute(wikipedia, wikipedia + 9) != 0x11E60398){
+		fprintf(stderr, "adler32 error\n");
+		return false;
+	}
+	// each kernel available on this cpu with every alignment, tail and chunk boundary
+	typedef zlib::adler32::kernel_type kernel_type;
+	std::vector<std::pair<const char *, kernel_type>> kernels;
+#ifdef CCFRAG_X86_64
+	kernels.push_back(std::make_pair("sse2", &zlib::adler32::execute_sse2));
+	if(cpu::has_avx2()){
+		kernels.push_back(std::make_pair("avx2", &zlib::adler32::execute_avx2));
+	}
+#endif
+	kernels.push_back(std::make_pair("selected", zlib::adler32::kernel()));
+	std::vector<char> data(20000);
+	for(size_t i = 0; i < data.size(); ++i){
+		data[i] = static_cast<char>(i % 7 == 0 ? 0xFF : i * 31);
+	}
+	// all 0xFF drives both sums to their largest values before each modulo
+	std::vector<char> ones(zlib::adler32::NMAX * 3 + 100, static_cast<char>(0xFF));
+	for(const auto * buffer : {&data, &ones}){
+		const uint8_t * bytes = reinterpret_cast<const uint8_t *>(buffer->data());
+		for(size_t size : {0, 1, 15, 16, 31, 32, 33, 100, 5552, 5553, 11104, 16656, 16756}){
+			if(buffer->size() < size + 8){
+				continue;
+			}
+			for(size_t offset = 0; offset < 8; ++offset){
+				for(uint32_t adler : {1U, ((zlib::adler32::BASE - 1U) << 16) | (zlib::adler32::BASE - 1U)}){
+					const uint32_t expected = zlib::adler32::execute_scalar(bytes + offset, size, adler);
+					for(auto& kernel : kernels){
+						if(kernel.second(bytes + offset, size, adler) != expected){
+							fprintf(stderr, "adler32 %s kernel error size=%zd offset=%zd\n", kernel.first, size, offset);
+							return false;
+						}
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static bool test_zlib(const std::vector<char>& data, const std::vector<char>& dictionary)
+{
+	std::vector<char> encoded, decoded;
+	if(!zlib::encode(encoded, data, deflate::DEFAULT_LEVEL, dictionary)){
+		fprintf(stderr, "zlib encode error\n");
+		return false;
+	}
+	if(!zlib::is_zlib(encoded.data(), encoded.size())){
+		fprintf(stderr, "zlib header error\n");
+		return false;
+	}
+	if(!zlib::decode(decoded, encoded, dictionary) || decoded != data){
+		fprintf(stderr, "zlib decode error %zd != %zd\n", decoded.size(), data.size());
+		return false;
+	}
+	if(!dictionary.empty() && zlib::decode(decoded, encoded)){
+		fprintf(stderr, "zlib decoded without dictionary\n");
+		return false;
+	}
+	// corrupted trailer
+	encoded.back() ^= 1;
+	if(zlib::decode(decoded, encoded, dictionary)){
+		fprintf(stderr, "zlib decoded with wrong adler32\n");
+		return false;
+	}
+	return true;
+}
+
+bool zlib_test()
+{
+	if(!test_adler32()) return false;
+	if(!test_zlib(std::vector<char>(), std::vector<char>())) return false;
+	if(!test_zlib(test_text_data(100000, 7), std::vector<char>())) return false;
+	std::vector<char> dictionary = test_text_data(40000, 7);
+	std::vector<char> data(dictionary.begin() + 35000, dictionary.begin() + 36000);
+	if(!test_zlib(data, dictionary)) return false;
+	return true;
+}
+
+TEST(zlib_test);